@@ -0,0 +1,166 @@
+#include "AllocStats.h"
+#include "ThreadCache.h"
+#include "CentralCache.h"
+#include "PageCache.h"
+#include <cstdarg>
+#include <cstdio>
+
+//ռǰͳϢ
+void GetAllocStats(AllocStats& stats)
+{
+	stats = AllocStats();
+
+	size_t frontObjs[NFREELISTS] = { 0 };
+	stats._threadCaches = ThreadCache::GetCachedObjects(frontObjs);
+	FreeListCounters listCounters[NFREELISTS];
+	ThreadCache::GetListCounters(listCounters);
+
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		SizeClassStats& cls = stats._classes[i];
+		cls._objSize = SizeClass::ClassSize(i);
+		CentralCache::GetInstance()->GetClassStats(i, cls._spans, cls._pages, cls._spanObjs,
+			cls._spanFreeObjs, cls._transferObjs);
+		cls._frontObjs = frontObjs[i];
+		cls._lists = listCounters[i];
+
+		stats._centralBytes += cls._pages << PAGE_SHIFT;
+		stats._frontBytes += cls._frontObjs * cls._objSize;
+		stats._transferBytes += cls._transferObjs * cls._objSize;
+		stats._spanFreeBytes += cls._spanFreeObjs * cls._objSize;
+		stats._inUseBytes += cls.InUseObjs() * cls._objSize;
+	}
+
+	PageCache::GetPageStats(stats._pageSpans, stats._largeSpans, stats._largeSpanPages,
+		stats._mappedBytes, stats._pageFreeBytes, stats._releasedBytes);
+	//ϵͳҳ˿еĺcentral cachespanʣµľֱӷȥĴڴ
+	size_t accounted = stats._pageFreeBytes + stats._releasedBytes + stats._centralBytes;
+	stats._largeInUseBytes = stats._mappedBytes > accounted ? stats._mappedBytes - accounted : 0;
+	stats._inUseBytes += stats._largeInUseBytes;
+
+	CentralCache::GetInstance()->GetLockStats(stats._centralLockAcquires, stats._centralLockContended);
+	PageCache::GetLockStats(stats._pageLockAcquires, stats._pageLockContended);
+}
+
+//printfʽ׷ӵoutĩβ
+static void Append(std::string& out, const char* format, ...)
+{
+	char buf[256];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	if (n > 0)
+	{
+		out.append(buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+	}
+}
+
+static double ToMiB(size_t bytes)
+{
+	return bytes / 1024.0 / 1024.0;
+}
+
+//ͳϢʽΪĶı
+std::string AllocStatsToText(const AllocStats& stats)
+{
+	std::string out;
+	Append(out, "------------------------------------------------\n");
+	Append(out, "ʹ      %14zu ֽ (%9.1f MiB)\n", stats._inUseBytes, ToMiB(stats._inUseBytes));
+	Append(out, "  дڴ    %14zu ֽ (%9.1f MiB)\n", stats._largeInUseBytes, ToMiB(stats._largeInUseBytes));
+	Append(out, "thread cache      %14zu ֽ (%9.1f MiB)\n", stats._frontBytes, ToMiB(stats._frontBytes));
+	Append(out, "仺          %14zu ֽ (%9.1f MiB)\n", stats._transferBytes, ToMiB(stats._transferBytes));
+	Append(out, "central cache %14zu ֽ (%9.1f MiB)\n", stats._spanFreeBytes, ToMiB(stats._spanFreeBytes));
+	Append(out, "page cache    %14zu ֽ (%9.1f MiB)\n", stats._pageFreeBytes, ToMiB(stats._pageFreeBytes));
+	Append(out, "ѹ黹ϵͳ      %14zu ֽ (%9.1f MiB)\n", stats._releasedBytes, ToMiB(stats._releasedBytes));
+	Append(out, "ϵͳ        %14zu ֽ (%9.1f MiB)\n", stats._mappedBytes, ToMiB(stats._mappedBytes));
+	Append(out, "ThreadCache   %14zu\n", stats._threadCaches);
+	Append(out, "Ͱ%zuΣ%zuΣpage cache arena%zuΣ%zu\n",
+		stats._centralLockAcquires, stats._centralLockContended,
+		stats._pageLockAcquires, stats._pageLockContended);
+
+	Append(out, "------------------------------------------------\n");
+	Append(out, "%5s %8s %7s %7s %10s %10s %10s %10s %10s %10s %10s %8s\n",
+		"Ͱ", "С", "span", "ҳ", "", "span", "仺", "̻߳", "ʹ",
+		"", "", "С");
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		const SizeClassStats& cls = stats._classes[i];
+		if (cls._spans == 0 && cls._frontObjs == 0)
+		{
+			continue;
+		}
+		Append(out, "%5zu %8zu %7zu %7zu %10zu %10zu %10zu %10zu %10zu %10zu %10zu %8zu\n",
+			i, cls._objSize, cls._spans, cls._pages, cls._spanObjs, cls._spanFreeObjs,
+			cls._transferObjs, cls._frontObjs, cls.InUseObjs(),
+			cls._lists._misses, cls._lists._overflows, cls._lists._shrinks);
+	}
+
+	Append(out, "------------------------------------------------\n");
+	Append(out, "page cachespanҳ: \n");
+	for (size_t k = 1; k < NPAGES; k++)
+	{
+		if (stats._pageSpans[k] != 0)
+		{
+			Append(out, "%5zu: %zu\n", k, stats._pageSpans[k]);
+		}
+	}
+	Append(out, ">%zu: %zu %zuҳ\n", NPAGES - 1, stats._largeSpans, stats._largeSpanPages);
+	return out;
+}
+
+//ͳϢʽΪJSONֻгǿյĹϣͰҳ
+std::string AllocStatsToJson(const AllocStats& stats)
+{
+	std::string out;
+	Append(out, "{\"in_use_bytes\":%zu,\"large_in_use_bytes\":%zu,\"thread_cache_bytes\":%zu,"
+		"\"transfer_cache_bytes\":%zu,\"central_free_bytes\":%zu,\"page_free_bytes\":%zu,",
+		stats._inUseBytes, stats._largeInUseBytes, stats._frontBytes,
+		stats._transferBytes, stats._spanFreeBytes, stats._pageFreeBytes);
+	Append(out, "\"released_bytes\":%zu,\"mapped_bytes\":%zu,\"central_bytes\":%zu,\"thread_caches\":%zu,",
+		stats._releasedBytes, stats._mappedBytes, stats._centralBytes, stats._threadCaches);
+	Append(out, "\"central_lock\":{\"acquires\":%zu,\"contended\":%zu},"
+		"\"page_lock\":{\"acquires\":%zu,\"contended\":%zu},",
+		stats._centralLockAcquires, stats._centralLockContended,
+		stats._pageLockAcquires, stats._pageLockContended);
+
+	Append(out, "\"size_classes\":[");
+	bool first = true;
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		const SizeClassStats& cls = stats._classes[i];
+		if (cls._spans == 0 && cls._frontObjs == 0)
+		{
+			continue;
+		}
+		Append(out, "%s{\"class\":%zu,\"size\":%zu,\"spans\":%zu,\"pages\":%zu,\"objs\":%zu,"
+			"\"span_free_objs\":%zu,\"transfer_objs\":%zu,\"thread_cache_objs\":%zu,\"in_use_objs\":%zu,",
+			first ? "" : ",", i, cls._objSize, cls._spans, cls._pages, cls._spanObjs,
+			cls._spanFreeObjs, cls._transferObjs, cls._frontObjs, cls.InUseObjs());
+		Append(out, "\"list_misses\":%zu,\"list_overflows\":%zu,\"list_shrinks\":%zu,\"list_idle_released\":%zu}",
+			cls._lists._misses, cls._lists._overflows, cls._lists._shrinks, cls._lists._idleReleased);
+		first = false;
+	}
+
+	Append(out, "],\"page_spans\":[");
+	first = true;
+	for (size_t k = 1; k < NPAGES; k++)
+	{
+		if (stats._pageSpans[k] != 0)
+		{
+			Append(out, "%s{\"pages\":%zu,\"spans\":%zu}", first ? "" : ",", k, stats._pageSpans[k]);
+			first = false;
+		}
+	}
+	Append(out, "],\"large_spans\":{\"spans\":%zu,\"pages\":%zu}}",
+		stats._largeSpans, stats._largeSpanPages);
+	return out;
+}
+
+//ռʽjsonΪtrueʱJSON
+std::string DumpAllocStats(bool json)
+{
+	AllocStats stats;
+	GetAllocStats(stats);
+	return json ? AllocStatsToJson(stats) : AllocStatsToText(stats);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Common.h"
+#include <string>
+
+//ͳƽӿڣtcmallocMallocExtensionڴֱһ㡢ĸϣͰ
+//ͳʱݽṹֻThreadCacheȸĳԭӱ̶߳ȡ
+//ͷŵĿ·ûжļȺȡģǽƵĿ
+
+//һϣͰͳ
+struct SizeClassStats
+{
+	size_t _objSize = 0;      //С
+	size_t _spans = 0;        //central cacheͰspan
+	size_t _pages = 0;        //Щspanҳ
+	size_t _spanObjs = 0;     //ЩspanгĶ
+	size_t _spanFreeObjs = 0; //spanеĶ
+	size_t _transferObjs = 0; //仺еĶ
+	size_t _frontObjs = 0;    //ThreadCacheper-CPU棩еĶ
+	FreeListCounters _lists;  //ThreadCacheϣͰȵڼ˳̣߳
+
+	//ڱʹõĶ
+	size_t InUseObjs() const
+	{
+		size_t cached = _spanFreeObjs + _transferObjs + _frontObjs;
+		return _spanObjs > cached ? _spanObjs - cached : 0;
+	}
+};
+
+struct AllocStats
+{
+	SizeClassStats _classes[NFREELISTS];
+
+	size_t _mappedBytes = 0;      //ϵͳ롢ûлϵͳֽ
+	size_t _pageFreeBytes = 0;    //page cacheпһڴеֽ
+	size_t _releasedBytes = 0;    //page cacheпѾ黹ϵͳַֽԱ
+	size_t _centralBytes = 0;     //central cachespanռõֽ
+	size_t _largeInUseBytes = 0;  //ֱӰҳȥĴڴ棨256KBҳ룩ֽ
+	size_t _frontBytes = 0;       //ThreadCacheлֽ
+	size_t _transferBytes = 0;    //仺еֽ
+	size_t _spanFreeBytes = 0;    //central cachespanпеֽ
+	size_t _inUseBytes = 0;       //ʹõֽĴСƣ
+	size_t _threadCaches = 0;     //ThreadCacheĸper-CPU棩
+
+	size_t _pageSpans[NPAGES] = { 0 }; //page cachekҳspanĸ
+	size_t _largeSpans = 0;       //page cacheг128ҳĿspan
+	size_t _largeSpanPages = 0;   //Щspanҳ
+
+	size_t _centralLockAcquires = 0;
+	size_t _centralLockContended = 0;
+	size_t _pageLockAcquires = 0;
+	size_t _pageLockContended = 0;
+};
+
+//ռǰͳϢ
+void GetAllocStats(AllocStats& stats);
+
+//ͳϢʽΪĶı
+std::string AllocStatsToText(const AllocStats& stats);
+
+//ͳϢʽΪJSONֻгǿյĹϣͰҳ
+std::string AllocStatsToJson(const AllocStats& stats);
+
+//ռʽjsonΪtrueʱJSON
+std::string DumpAllocStats(bool json = false);
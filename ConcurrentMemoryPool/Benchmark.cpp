@@ -1,65 +1,790 @@
 //׼
+//
+//Benchmark [ѡ]            Ĳ׼ÿءСֱֲ߳һӽУ
+//                            ԱConcurrentAllocϵͳmallocglibcԼLD_PRELOADָ
+//Benchmark components        רԣͷ·per-CPU桢page cacheչԡѡԡspan
+//Benchmark hugepage          ҳģʽЧ
+//Benchmark stats[-json]      ڱConcurrentAllocһأȻͳϢ
+//
+//׼ѡ
+//-w batch,prodcons,larson,xmalloc  
+//-d fixed,uniform,lognormal        Сķֲ
+//-t 1,2,4,8                        ߳
+//-n 200000                         ÿ߳Ĵ
+//--preload lib.so                  LD_PRELOAD=lib.so滻mallocһ飬ָΣ
+//                                  ʱLD_PRELOADеĿҲԱ
 
 #include "ConcurrentAlloc.h"
+#include "AllocStats.h"
 #include "ObjectPool.h"
+#include "ConcurrentObjectPool.h"
+#include "CentralCache.h"
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
 
-//ntimesִͷڴĴ
-//nworks߳
-//roundsִΣ֣ܶ
-void BenchmarkMalloc(size_t ntimes, size_t nworks, size_t rounds)
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+	#include <limits.h>
+#endif
+
+#ifdef _WIN32
+	#define popen _popen
+	#define pclose _pclose
+#endif
+
+static inline uint64_t NowNs()
 {
-	std::vector<std::thread> vthread(nworks);
-	std::atomic<size_t> malloc_costtime = 0;
-	std::atomic<size_t> free_costtime = 0;
-	for (size_t k = 0; k < nworks; ++k)
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//ǰռõڴ棨RSSֵֽ֧ƽ̨0
+static size_t CurrentRssBytes()
+{
+#ifdef __linux__
+	size_t pages = 0, rss = 0;
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f != nullptr)
 	{
-		vthread[k] = std::thread([&, k]() {
-			std::vector<void*> v;
-			v.reserve(ntimes);
-			for (size_t j = 0; j < rounds; ++j)
+		if (fscanf(f, "%zu %zu", &pages, &rss) != 2)
+			rss = 0;
+		fclose(f);
+	}
+	return rss * (size_t)sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+//ӳֱͼÿ2ٵȷֳ8Ͱ12.5%
+class LatencyHistogram
+{
+public:
+	static const size_t SUB_BUCKETS = 8;
+	static const size_t NBUCKETS = 64 * SUB_BUCKETS;
+
+	void Record(uint64_t ns)
+	{
+		_counts[BucketOf(ns)]++;
+		_total++;
+	}
+
+	void Merge(const LatencyHistogram& other)
+	{
+		for (size_t i = 0; i < NBUCKETS; i++)
+		{
+			_counts[i] += other._counts[i];
+		}
+		_total += other._total;
+	}
+
+	//q0~1λȡͰ½
+	uint64_t Percentile(double q) const
+	{
+		uint64_t rank = (uint64_t)(q * _total);
+		uint64_t seen = 0;
+		for (size_t i = 0; i < NBUCKETS; i++)
+		{
+			seen += _counts[i];
+			if (seen > rank)
 			{
-				size_t begin1 = clock();
-				for (size_t i = 0; i < ntimes; i++)
+				return LowerBound(i);
+			}
+		}
+		return 0;
+	}
+
+private:
+	static size_t BucketOf(uint64_t ns)
+	{
+		if (ns < SUB_BUCKETS)
+		{
+			return (size_t)ns;
+		}
+		size_t log = 3; //nsλ1λãns >= 8ʱ3
+		while ((ns >> (log + 1)) != 0)
+		{
+			log++;
+		}
+		size_t sub = (size_t)(ns >> (log - 3)) & (SUB_BUCKETS - 1);
+		return (log - 2) * SUB_BUCKETS + sub;
+	}
+
+	static uint64_t LowerBound(size_t bucket)
+	{
+		if (bucket < SUB_BUCKETS)
+		{
+			return bucket;
+		}
+		size_t log = bucket / SUB_BUCKETS + 2;
+		return (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << (log - 3);
+	}
+
+	uint64_t _counts[NBUCKETS] = { 0 };
+	uint64_t _total = 0;
+};
+
+//ÿٴβһӳ٣ʱӱҪʮ룬ÿζ
+static const size_t LATENCY_SAMPLE_EVERY = 16;
+//ʱӵĹ̶Ӳ⵽ӳп۳
+static uint64_t timerOverhead = 0;
+
+static void CalibrateTimer()
+{
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < 1000; i++)
+	{
+		uint64_t begin = NowNs();
+		uint64_t end = NowNs();
+		best = min(best, end - begin);
+	}
+	timerOverhead = best;
+}
+
+//ķ׼ֻõͣСģͷţߵĽӿͬȽϲŹƽ
+struct CmpAllocator
+{
+	static void* Alloc(size_t size)
+	{
+		return ConcurrentAlloc(size);
+	}
+	static void Free(void* ptr)
+	{
+		ConcurrentFree(ptr);
+	}
+};
+
+//ϵͳmallocLD_PRELOAD滻Ǳ滻ķ
+struct SystemAllocator
+{
+	static void* Alloc(size_t size)
+	{
+		return malloc(size);
+	}
+	static void Free(void* ptr)
+	{
+		free(ptr);
+	}
+};
+
+//һ̵߳ĲԽ
+struct ThreadResult
+{
+	LatencyHistogram _alloc;
+	LatencyHistogram _free;
+	size_t _allocs = 0; //
+	size_t _frees = 0;  //ͷŴ
+};
+
+//һдһֽڣҲֹѳɶԵͷŻÿLATENCY_SAMPLE_EVERYβһӳ
+template<class A>
+static inline void* TimedAlloc(size_t size, ThreadResult& result)
+{
+	if (result._allocs++ % LATENCY_SAMPLE_EVERY != 0)
+	{
+		char* ptr = (char*)A::Alloc(size);
+		*ptr = 1;
+		return ptr;
+	}
+	uint64_t begin = NowNs();
+	char* ptr = (char*)A::Alloc(size);
+	uint64_t end = NowNs();
+	result._alloc.Record(end - begin > timerOverhead ? end - begin - timerOverhead : 0);
+	*ptr = 1;
+	return ptr;
+}
+
+template<class A>
+static inline void TimedFree(void* ptr, ThreadResult& result)
+{
+	if (result._frees++ % LATENCY_SAMPLE_EVERY != 0)
+	{
+		A::Free(ptr);
+		return;
+	}
+	uint64_t begin = NowNs();
+	A::Free(ptr);
+	uint64_t end = NowNs();
+	result._free.Record(end - begin > timerOverhead ? end - begin - timerOverhead : 0);
+}
+
+//Сķֲÿ߳ԤһСѭʹãʱѭв
+enum SizeDist
+{
+	DIST_FIXED,     //̶64ֽ
+	DIST_UNIFORM,   //[1, 8192]ȷֲ
+	DIST_LOGNORMAL, //ֲ̬λԼ100ֽڣβʮKBͳСֲӽ
+};
+
+static const char* DIST_NAMES[] = { "fixed", "uniform", "lognormal" };
+
+class SizeSequence
+{
+public:
+	static const size_t N = 8192;
+
+	SizeSequence(SizeDist dist, size_t seed)
+	{
+		std::mt19937_64 rng(seed);
+		std::uniform_int_distribution<size_t> uniform(1, 8192);
+		std::lognormal_distribution<double> lognormal(4.6, 1.3);
+		for (size_t i = 0; i < N; i++)
+		{
+			if (dist == DIST_FIXED)
+			{
+				_sizes[i] = 64;
+			}
+			else if (dist == DIST_UNIFORM)
+			{
+				_sizes[i] = uniform(rng);
+			}
+			else
+			{
+				_sizes[i] = min((size_t)lognormal(rng) + 1, MAX_BYTES);
+			}
+		}
+	}
+
+	size_t operator[](size_t i) const
+	{
+		return _sizes[i % N];
+	}
+
+private:
+	size_t _sizes[N];
+};
+
+//أÿnthreadsִ߳Уÿ̴߳Լnβȫͷţ
+//ؼʱֵǽʱ䣬̵߳Ľresults
+typedef uint64_t(*Workload)(SizeDist dist, size_t nthreads, size_t n, std::vector<ThreadResult>& results);
+
+//batchÿ߳һٰ˳ȫͷţ֣ͷŶͬһ߳
+template<class A>
+static uint64_t WorkloadBatch(SizeDist dist, size_t nthreads, size_t n, std::vector<ThreadResult>& results)
+{
+	const size_t batch = 1024;
+	results.assign(nthreads, ThreadResult());
+	std::vector<std::thread> threads(nthreads);
+	uint64_t begin = NowNs();
+	for (size_t k = 0; k < nthreads; k++)
+	{
+		threads[k] = std::thread([&, k]() {
+			SizeSequence sizes(dist, k + 1);
+			std::vector<void*> v(batch);
+			for (size_t done = 0; done < n; done += batch)
+			{
+				for (size_t i = 0; i < batch; i++)
 				{
-					//v.push_back(malloc(16));
-					v.push_back(malloc((16 + i) % 8192 + 1));
+					v[i] = TimedAlloc<A>(sizes[done + i], results[k]);
 				}
-				size_t end1 = clock();
-				size_t begin2 = clock();
-				for (size_t i = 0; i < ntimes; i++)
+				for (size_t i = 0; i < batch; i++)
 				{
-					free(v[i]);
+					TimedFree<A>(v[i], results[k]);
 				}
-				size_t end2 = clock();
-				v.clear();
-				malloc_costtime += (end1 - begin1);
-				free_costtime += (end2 - begin2);
 			}
 		});
 	}
-	for (auto& t : vthread)
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	return NowNs() - begin;
+}
+
+//ߵߵĻζ
+class PtrRing
+{
+public:
+	bool Push(void* ptr)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail - _head.load(std::memory_order_acquire) == CAPACITY)
+		{
+			return false;
+		}
+		_slots[tail % CAPACITY] = ptr;
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	void* Pop()
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire))
+		{
+			return nullptr;
+		}
+		void* ptr = _slots[head % CAPACITY];
+		_head.store(head + 1, std::memory_order_release);
+		return ptr;
+	}
+
+private:
+	static const size_t CAPACITY = 4096;
+	void* _slots[CAPACITY];
+	alignas(64) std::atomic<size_t> _head{ 0 };
+	alignas(64) std::atomic<size_t> _tail{ 0 };
+};
+
+//prodcons߳ԣ󽻸ͷţÿǿ߳ͷŵ
+template<class A>
+static uint64_t WorkloadProdCons(SizeDist dist, size_t nthreads, size_t n, std::vector<ThreadResult>& results)
+{
+	size_t npairs = nthreads / 2;
+	results.assign(npairs * 2, ThreadResult());
+	std::vector<PtrRing> rings(npairs);
+	std::vector<std::thread> threads(npairs * 2);
+	uint64_t begin = NowNs();
+	for (size_t k = 0; k < npairs; k++)
+	{
+		threads[2 * k] = std::thread([&, k]() {
+			SizeSequence sizes(dist, k + 1);
+			for (size_t i = 0; i < n; i++)
+			{
+				void* ptr = TimedAlloc<A>(sizes[i], results[2 * k]);
+				while (!rings[k].Push(ptr))
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+		threads[2 * k + 1] = std::thread([&, k]() {
+			for (size_t i = 0; i < n; i++)
+			{
+				void* ptr = nullptr;
+				while ((ptr = rings[k].Pop()) == nullptr)
+				{
+					std::this_thread::yield();
+				}
+				TimedFree<A>(ptr, results[2 * k + 1]);
+			}
+		});
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	return NowNs() - begin;
+}
+
+//larsonÿ߳ͷԼλеһһµģ
+//ֳɼÿһ߳˳λһ̣߳һ߳Ķ߳ͷ
+template<class A>
+static uint64_t WorkloadLarson(SizeDist dist, size_t nthreads, size_t n, std::vector<ThreadResult>& results)
+{
+	const size_t slots = 1000;
+	const size_t generations = 4;
+	results.assign(nthreads, ThreadResult());
+	std::vector<std::vector<void*>> arrays(nthreads, std::vector<void*>(slots));
+	for (size_t k = 0; k < nthreads; k++)
+	{
+		SizeSequence sizes(dist, k + 1);
+		for (size_t i = 0; i < slots; i++)
+		{
+			arrays[k][i] = A::Alloc(sizes[i]);
+		}
+	}
+
+	uint64_t begin = NowNs();
+	for (size_t g = 0; g < generations; g++)
+	{
+		std::vector<std::thread> threads(nthreads);
+		for (size_t k = 0; k < nthreads; k++)
+		{
+			threads[k] = std::thread([&, k, g]() {
+				std::vector<void*>& v = arrays[(k + g) % nthreads]; //ÿһһλ
+				SizeSequence sizes(dist, k * generations + g + 1);
+				uint64_t x = k * 2654435761u + g + 1;
+				for (size_t i = 0; i < n / generations; i++)
+				{
+					x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+					size_t slot = (size_t)(x >> 33) % slots;
+					TimedFree<A>(v[slot], results[k]);
+					v[slot] = TimedAlloc<A>(sizes[i], results[k]);
+				}
+			});
+		}
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+	}
+	uint64_t wall = NowNs() - begin;
+
+	for (auto& v : arrays)
+	{
+		for (void* ptr : v)
+		{
+			A::Free(ptr);
+		}
+	}
+	return wall;
+}
+
+//xmalloc̰߳ĶŽһջٴջȡһͨ߳ģͷ
+template<class A>
+static uint64_t WorkloadXmalloc(SizeDist dist, size_t nthreads, size_t n, std::vector<ThreadResult>& results)
+{
+	const size_t batch = 64;
+	results.assign(nthreads, ThreadResult());
+	std::mutex mtx;
+	std::vector<std::vector<void*>> shared;
+	std::vector<std::thread> threads(nthreads);
+	uint64_t begin = NowNs();
+	for (size_t k = 0; k < nthreads; k++)
+	{
+		threads[k] = std::thread([&, k]() {
+			SizeSequence sizes(dist, k + 1);
+			std::vector<void*> mine;
+			for (size_t done = 0; done < n; done += batch)
+			{
+				mine.resize(batch);
+				for (size_t i = 0; i < batch; i++)
+				{
+					mine[i] = TimedAlloc<A>(sizes[done + i], results[k]);
+				}
+				{
+					std::unique_lock<std::mutex> lock(mtx);
+					shared.push_back(std::move(mine));
+					mine = std::move(shared.front());
+					shared.front() = std::move(shared.back());
+					shared.pop_back();
+				}
+				for (void* ptr : mine)
+				{
+					TimedFree<A>(ptr, results[k]);
+				}
+			}
+		});
+	}
+	for (auto& t : threads)
 	{
 		t.join();
 	}
-	/*printf("%uִ̲߳%uִΣÿִmalloc %u: ѣ%u ms\n",
-		nworks, rounds, ntimes, malloc_costtime);
-	printf("%uִ̲߳%uִΣÿִfree %u: ѣ%u ms\n",
-		nworks, rounds, ntimes, free_costtime);
-	printf("%u̲߳malloc&free %uΣܼƻѣ%u ms\n",
-		nworks, nworks*rounds*ntimes, malloc_costtime + free_costtime);*/
-	printf("%uִ̲߳%uִΣÿִmalloc %u: ѣ%u ms\n",
-		(unsigned int)nworks, (unsigned int)rounds, (unsigned int)ntimes, (unsigned int)malloc_costtime);
-	printf("%uִ̲߳%uִΣÿִfree %u: ѣ%u ms\n",
-		(unsigned int)nworks, (unsigned int)rounds, (unsigned int)ntimes, (unsigned int)free_costtime);
-	printf("%u̲߳malloc&free %uΣܼƻѣ%u ms\n",
-		(unsigned int)nworks, (unsigned int)(nworks * rounds * ntimes), (unsigned int)(malloc_costtime + free_costtime));
+	uint64_t wall = NowNs() - begin;
+	for (auto& v : shared)
+	{
+		for (void* ptr : v)
+		{
+			A::Free(ptr);
+		}
+	}
+	return wall;
 }
 
-void BenchmarkConcurrentMalloc(size_t ntimes, size_t nworks, size_t rounds)
+struct WorkloadInfo
+{
+	const char* _name;
+	Workload _cmp;
+	Workload _system;
+	size_t _minThreads;
+};
+
+static const WorkloadInfo WORKLOADS[] = {
+	{ "batch", WorkloadBatch<CmpAllocator>, WorkloadBatch<SystemAllocator>, 1 },
+	{ "prodcons", WorkloadProdCons<CmpAllocator>, WorkloadProdCons<SystemAllocator>, 2 },
+	{ "larson", WorkloadLarson<CmpAllocator>, WorkloadLarson<SystemAllocator>, 1 },
+	{ "xmalloc", WorkloadXmalloc<CmpAllocator>, WorkloadXmalloc<SystemAllocator>, 1 },
+};
+
+static const WorkloadInfo* FindWorkload(const std::string& name)
+{
+	for (const WorkloadInfo& w : WORKLOADS)
+	{
+		if (name == w._name)
+		{
+			return &w;
+		}
+	}
+	return nullptr;
+}
+
+static bool FindDist(const std::string& name, SizeDist& dist)
+{
+	for (size_t i = 0; i < 3; i++)
+	{
+		if (name == DIST_NAMES[i])
+		{
+			dist = (SizeDist)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+//һβԵĻܽ
+struct RunResult
+{
+	size_t _threads = 0;
+	size_t _ops = 0;
+	uint64_t _wallNs = 0;
+	uint64_t _alloc[3] = { 0 }; //ӳٵp50p99p99.9
+	uint64_t _free[3] = { 0 };
+	size_t _rssBefore = 0;
+	size_t _rssAfter = 0;      //ȫͷ֮
+};
+
+static RunResult RunWorkload(Workload workload, SizeDist dist, size_t nthreads, size_t n)
+{
+	RunResult run;
+	std::vector<ThreadResult> results;
+	run._rssBefore = CurrentRssBytes();
+	run._wallNs = workload(dist, nthreads, n, results);
+	run._rssAfter = CurrentRssBytes();
+
+	LatencyHistogram allocHist, freeHist;
+	for (const ThreadResult& r : results)
+	{
+		allocHist.Merge(r._alloc);
+		freeHist.Merge(r._free);
+		run._ops += r._allocs + r._frees;
+	}
+	run._threads = results.size();
+	const double qs[3] = { 0.5, 0.99, 0.999 };
+	for (size_t i = 0; i < 3; i++)
+	{
+		run._alloc[i] = allocHist.Percentile(qs[i]);
+		run._free[i] = freeHist.Percentile(qs[i]);
+	}
+	return run;
+}
+
+//ӽ̣Benchmark run cmp|malloc  ֲ ߳ һ
+static int RunChild(int argc, char* argv[])
+{
+	if (argc != 7)
+	{
+		return 2;
+	}
+	const WorkloadInfo* w = FindWorkload(argv[3]);
+	SizeDist dist = DIST_FIXED;
+	if (w == nullptr || !FindDist(argv[4], dist))
+	{
+		return 2;
+	}
+	CalibrateTimer();
+	Workload workload = strcmp(argv[2], "cmp") == 0 ? w->_cmp : w->_system;
+	RunResult r = RunWorkload(workload, dist, (size_t)atoi(argv[5]), (size_t)atoi(argv[6]));
+	printf("ROW %zu %zu %llu %llu %llu %llu %llu %llu %llu %zu %zu\n", r._threads, r._ops,
+		(unsigned long long)r._wallNs, (unsigned long long)r._alloc[0], (unsigned long long)r._alloc[1],
+		(unsigned long long)r._alloc[2], (unsigned long long)r._free[0], (unsigned long long)r._free[1],
+		(unsigned long long)r._free[2], r._rssBefore, r._rssAfter);
+	return 0;
+}
+
+//ԱȵķcmpConcurrentAlloc඼ǵmalloc_preloadӽ̵LD_PRELOAD
+struct Contender
+{
+	std::string _label;
+	std::string _kind;
+	std::string _preload;
+};
+
+static std::string SelfPath(const char* argv0)
+{
+#ifdef __linux__
+	char buf[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+	if (len > 0)
+	{
+		return std::string(buf, (size_t)len);
+	}
+#endif
+	return argv0;
+}
+
+static std::vector<std::string> Split(const std::string& s, const char* seps)
+{
+	std::vector<std::string> parts;
+	size_t pos = 0;
+	while (pos <= s.size())
+	{
+		size_t next = s.find_first_of(seps, pos);
+		if (next == std::string::npos)
+		{
+			next = s.size();
+		}
+		if (next > pos)
+		{
+			parts.push_back(s.substr(pos, next - pos));
+		}
+		pos = next + 1;
+	}
+	return parts;
+}
+
+static bool RunContender(const std::string& self, const Contender& c, const char* workload, SizeDist dist,
+	size_t nthreads, size_t n, RunResult& r)
+{
+	std::string cmd;
+#ifdef __linux__
+	cmd = "LD_PRELOAD='" + c._preload + "' ";
+#endif
+	cmd += "\"" + self + "\" run " + c._kind + " " + workload + " " + DIST_NAMES[dist] + " "
+		+ std::to_string(nthreads) + " " + std::to_string(n);
+	FILE* pipe = popen(cmd.c_str(), "r");
+	if (pipe == nullptr)
+	{
+		return false;
+	}
+	bool ok = false;
+	char line[512];
+	while (fgets(line, sizeof(line), pipe) != nullptr)
+	{
+		unsigned long long v[9];
+		if (sscanf(line, "ROW %zu %zu %llu %llu %llu %llu %llu %llu %llu %llu %llu", &r._threads, &r._ops,
+			&v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8]) == 11)
+		{
+			r._wallNs = v[0];
+			for (size_t i = 0; i < 3; i++)
+			{
+				r._alloc[i] = v[1 + i];
+				r._free[i] = v[4 + i];
+			}
+			r._rssBefore = (size_t)v[7];
+			r._rssAfter = (size_t)v[8];
+			ok = true;
+		}
+	}
+	return pclose(pipe) == 0 && ok;
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: Benchmark [-w batch,prodcons,larson,xmalloc] [-d fixed,uniform,lognormal] "
+		"[-t 1,2,4,8] [-n ops_per_thread] [--preload lib.so]...\n"
+		"       Benchmark components | hugepage | stats | stats-json\n");
+	exit(2);
+}
+
+//Ĳ׼
+static int RunSuite(int argc, char* argv[])
+{
+	std::vector<std::string> workloads = { "batch", "prodcons", "larson", "xmalloc" };
+	std::vector<std::string> dists = { "fixed", "uniform", "lognormal" };
+	std::vector<size_t> threadCounts = { 1, 2, 4, 8 };
+	size_t n = 200000;
+#ifdef __GLIBC__
+	const char* systemLabel = "glibc malloc";
+#else
+	const char* systemLabel = "system malloc";
+#endif
+	std::vector<Contender> contenders = { { "ConcurrentAlloc", "cmp", "" }, { systemLabel, "malloc", "" } };
+#ifdef __linux__
+	//ʱͨLD_PRELOAD滻mallocҲԱȣӽLD_PRELOAD
+	const char* envPreload = getenv("LD_PRELOAD");
+	if (envPreload != nullptr)
+	{
+		for (const std::string& lib : Split(envPreload, ": "))
+		{
+			contenders.push_back({ lib.substr(lib.find_last_of('/') + 1), "malloc", lib });
+		}
+	}
+#endif
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (i + 1 >= argc)
+		{
+			Usage();
+		}
+		if (arg == "-w")
+		{
+			workloads = Split(argv[++i], ",");
+		}
+		else if (arg == "-d")
+		{
+			dists = Split(argv[++i], ",");
+		}
+		else if (arg == "-t")
+		{
+			threadCounts.clear();
+			for (const std::string& t : Split(argv[++i], ","))
+			{
+				threadCounts.push_back((size_t)atoi(t.c_str()));
+			}
+		}
+		else if (arg == "-n")
+		{
+			n = (size_t)atoll(argv[++i]);
+		}
+		else if (arg == "--preload")
+		{
+			std::string lib = argv[++i];
+			contenders.push_back({ lib.substr(lib.find_last_of('/') + 1), "malloc", lib });
+		}
+		else
+		{
+			Usage();
+		}
+	}
+	for (const std::string& w : workloads)
+	{
+		SizeDist dist = DIST_FIXED;
+		if (FindWorkload(w) == nullptr)
+			Usage();
+		for (const std::string& d : dists)
+		{
+			if (!FindDist(d, dist))
+				Usage();
+		}
+	}
+
+	std::string self = SelfPath(argv[0]);
+	printf("%-9s %-9s %4s %-16s %8s %7s %7s %8s %7s %7s %8s %9s %9s\n", "", "Сֲ", "߳",
+		"", "Mops/s", "p50", "p99", "p99.9", "ͷp50", "p99", "p99.9", "RSSǰ(MB)", "RSS(MB)");
+	for (const std::string& w : workloads)
+	{
+		const WorkloadInfo* info = FindWorkload(w);
+		for (const std::string& d : dists)
+		{
+			SizeDist dist = DIST_FIXED;
+			FindDist(d, dist);
+			for (size_t nthreads : threadCounts)
+			{
+				if (nthreads < info->_minThreads)
+				{
+					continue;
+				}
+				for (const Contender& c : contenders)
+				{
+					RunResult r;
+					printf("%-9s %-9s %4zu %-16s ", w.c_str(), d.c_str(), nthreads, c._label.c_str());
+					fflush(stdout);
+					if (!RunContender(self, c, info->_name, dist, nthreads, n, r))
+					{
+						printf("ʧ\n");
+						continue;
+					}
+					printf("%8.2f %7llu %7llu %8llu %7llu %7llu %8llu %9.1f %9.1f\n",
+						r._wallNs > 0 ? r._ops * 1000.0 / r._wallNs : 0.0,
+						(unsigned long long)r._alloc[0], (unsigned long long)r._alloc[1],
+						(unsigned long long)r._alloc[2], (unsigned long long)r._free[0],
+						(unsigned long long)r._free[1], (unsigned long long)r._free[2],
+						r._rssBefore / 1024.0 / 1024.0, r._rssAfter / 1024.0 / 1024.0);
+					fflush(stdout);
+				}
+			}
+		}
+	}
+	printf("ӳٵĵλnsÿ%zuβһΣѿ۳ʱӵĿRSSȫͷ֮\n",
+		LATENCY_SAMPLE_EVERY);
+	return 0;
+}
+
+//Աͷ·ConcurrentFree(ptr)ҳsize classConcurrentFree(ptr, size)ȫ
+void BenchmarkConcurrentFreePath(size_t ntimes, size_t nworks, size_t rounds)
 {
 	std::vector<std::thread> vthread(nworks);
-	std::atomic<size_t> malloc_costtime = 0;
-	std::atomic<size_t> free_costtime = 0;
+	std::atomic<uint64_t> free_costtime{ 0 };
+	std::atomic<uint64_t> sized_free_costtime{ 0 };
 	for (size_t k = 0; k < nworks; ++k)
 	{
 		vthread[k] = std::thread([&]() {
@@ -67,22 +792,32 @@ void BenchmarkConcurrentMalloc(size_t ntimes, size_t nworks, size_t rounds)
 			v.reserve(ntimes);
 			for (size_t j = 0; j < rounds; ++j)
 			{
-				size_t begin1 = clock();
 				for (size_t i = 0; i < ntimes; i++)
 				{
-					//v.push_back(ConcurrentAlloc(16));
 					v.push_back(ConcurrentAlloc((16 + i) % 8192 + 1));
 				}
-				size_t end1 = clock();
-				size_t begin2 = clock();
+				uint64_t begin1 = NowNs();
 				for (size_t i = 0; i < ntimes; i++)
 				{
 					ConcurrentFree(v[i]);
 				}
-				size_t end2 = clock();
+				uint64_t end1 = NowNs();
+				v.clear();
+
+				for (size_t i = 0; i < ntimes; i++)
+				{
+					v.push_back(ConcurrentAlloc((16 + i) % 8192 + 1));
+				}
+				uint64_t begin2 = NowNs();
+				for (size_t i = 0; i < ntimes; i++)
+				{
+					ConcurrentFree(v[i], (16 + i) % 8192 + 1);
+				}
+				uint64_t end2 = NowNs();
 				v.clear();
-				malloc_costtime += (end1 - begin1);
-				free_costtime += (end2 - begin2);
+
+				free_costtime += (end1 - begin1);
+				sized_free_costtime += (end2 - begin2);
 			}
 		});
 	}
@@ -90,26 +825,475 @@ void BenchmarkConcurrentMalloc(size_t ntimes, size_t nworks, size_t rounds)
 	{
 		t.join();
 	}
-	/*printf("%uִ̲߳%uִΣÿִconcurrent alloc %u: ѣ%u ms\n",
-		nworks, rounds, ntimes, malloc_costtime);
-	printf("%uִ̲߳%uִΣÿִconcurrent dealloc %u: ѣ%u ms\n",
-		nworks, rounds, ntimes, free_costtime);
-	printf("%u̲߳concurrent alloc&dealloc %uΣܼƻѣ%u ms\n",
-		nworks, nworks*rounds*ntimes, malloc_costtime + free_costtime);*/
+	size_t ops = nworks * rounds * ntimes;
+	printf("%uִ̲߳%uִΣÿִconcurrent dealloc %u: ƽ%.1f ns/\n",
+		(unsigned int)nworks, (unsigned int)rounds, (unsigned int)ntimes, (double)free_costtime / ops);
+	printf("%uִ̲߳%uִΣÿִsized concurrent dealloc %u: ƽ%.1f ns/\n",
+		(unsigned int)nworks, (unsigned int)rounds, (unsigned int)ntimes, (double)sized_free_costtime / ops);
+}
 
-	printf("%uִ̲߳%uִΣÿִconcurrent alloc %u: ѣ%u ms\n",
-		(unsigned int)nworks, (unsigned int)rounds, (unsigned int)ntimes, (unsigned int)malloc_costtime);
+//̻߳ģʽper-CPUģʽڲͬ߳µĶԱȣbatchءֲ̬
+void BenchmarkCpuCacheMode(size_t ntimes)
+{
+	size_t nworksArray[3] = { 4, 16, 256 };
+	for (size_t nworks : nworksArray)
+	{
+		CpuCache::GetInstance()->SetEnabled(false);
+		RunResult r = RunWorkload(WorkloadBatch<CmpAllocator>, DIST_LOGNORMAL, nworks, ntimes);
+		printf("[thread cache] %u̸߳ͷ%u: %.2f Mops/s\n", (unsigned int)nworks,
+			(unsigned int)ntimes, r._ops * 1000.0 / r._wallNs);
+		if (CpuCache::GetInstance()->SetEnabled(true))
+		{
+			r = RunWorkload(WorkloadBatch<CmpAllocator>, DIST_LOGNORMAL, nworks, ntimes);
+			printf("[per-cpu cache, %u caches] %u̸߳ͷ%u: %.2f Mops/s\n",
+				(unsigned int)CpuCache::GetInstance()->NumCaches(), (unsigned int)nworks,
+				(unsigned int)ntimes, r._ops * 1000.0 / r._wallNs);
+			CpuCache::GetInstance()->SetEnabled(false);
+		}
+		else
+		{
+			printf("rseqãper-CPUģʽ\n");
+		}
+	}
 }
 
-int main()
+//ӡһͳͰpage cache arenaļ
+void PrintLockStats()
 {
-	size_t n = 10000;
-	cout << "==========================================================" <<
-		endl;
-	BenchmarkConcurrentMalloc(n, 4, 10);
-	cout << endl << endl;
-	BenchmarkMalloc(n, 4, 10);
-	cout << "==========================================================" <<
-		endl;
-	return 0;
-}
\ No newline at end of file
+	size_t bucketAcquires = 0, bucketContended = 0;
+	CentralCache::GetInstance()->GetLockStats(bucketAcquires, bucketContended);
+	size_t pageAcquires = 0, pageContended = 0;
+	PageCache::GetLockStats(pageAcquires, pageContended);
+	printf("Ͱ%uΣ%uΣpage cache arena%uΣ%u\n",
+		(unsigned int)bucketAcquires, (unsigned int)bucketContended,
+		(unsigned int)pageAcquires, (unsigned int)pageContended);
+	CentralCache::GetInstance()->ResetLockStats();
+	PageCache::ResetLockStats();
+}
+
+//span״δ̸ϣͰûspanʱÿsize classһ
+//ͳƳפڴܺʱspanȡʱзֻ֣бȡߵĶڵҳȱҳ
+void BenchmarkFirstTouch()
+{
+	size_t rss = CurrentRssBytes();
+	std::vector<void*> v(NFREELISTS);
+	uint64_t begin = NowNs();
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		v[i] = ConcurrentAlloc(SizeClass::ClassSize(i));
+	}
+	uint64_t elapsed = NowNs() - begin;
+	size_t grown = CurrentRssBytes() - rss;
+	printf("[״δ] %usize class1: ʱ%.1f usפڴ%.1f KB\n",
+		(unsigned int)NFREELISTS, elapsed / 1000.0, grown / 1024.0);
+	for (void* p : v)
+	{
+		ConcurrentFree(p);
+	}
+}
+
+//߳ͷģʽЧprodconsÿһ߳ͷţ
+//رʱߵcentral cacheٴcentral cacheȡأֱӻص
+void BenchmarkRemoteFree(size_t ntimes, size_t nworks)
+{
+	for (int on = 0; on < 2; on++)
+	{
+		ThreadCache::SetRemoteFree(on == 1);
+		CentralCache::GetInstance()->ResetLockStats();
+		RunResult r = RunWorkload(WorkloadProdCons<CmpAllocator>, DIST_LOGNORMAL, nworks, ntimes);
+		size_t acquires = 0, contended = 0;
+		CentralCache::GetInstance()->GetLockStats(acquires, contended);
+		printf("[߳ͷ%s] %u߳롢ͷŸ%u: %.2f Mops/sp99 %u ns"
+			"ͷp99 %u nsͰ%u\n", on ? "" : "ر", (unsigned int)r._threads,
+			(unsigned int)ntimes, r._ops * 1000.0 / r._wallNs, (unsigned int)r._alloc[1],
+			(unsigned int)r._free[1], (unsigned int)acquires);
+	}
+	ThreadCache::SetRemoteFree(false);
+	CentralCache::GetInstance()->ResetLockStats();
+}
+
+//йϣͰȵڼ֮
+static FreeListCounters TotalListCounters()
+{
+	FreeListCounters counters[NFREELISTS];
+	ThreadCache::GetListCounters(counters);
+	FreeListCounters total;
+	for (const FreeListCounters& c : counters)
+	{
+		total._misses += c._misses;
+		total._overflows += c._overflows;
+		total._shrinks += c._shrinks;
+		total._idleReleased += c._idleReleased;
+	}
+	return total;
+}
+
+//ȵӦڣThreadCacheĲ䡢СͿм黹صĶ
+//Լɴ˲ͰThreadCache::MAX_LIST_BATCHESȲʱԱ
+void BenchmarkAdaptiveLists(size_t ntimes, size_t nworks)
+{
+	for (const WorkloadInfo& w : WORKLOADS)
+	{
+		FreeListCounters before = TotalListCounters();
+		CentralCache::GetInstance()->ResetLockStats();
+		RunResult r = RunWorkload(w._cmp, DIST_LOGNORMAL, nworks, ntimes);
+		FreeListCounters after = TotalListCounters();
+		size_t acquires = 0, contended = 0;
+		CentralCache::GetInstance()->GetLockStats(acquires, contended);
+		printf("[] %-8s %u߳: %.2f Mops/s%uΣ%uΣС%uΣ"
+			"л%uͰ%u\n", w._name, (unsigned int)r._threads, r._ops * 1000.0 / r._wallNs,
+			(unsigned int)(after._misses - before._misses), (unsigned int)(after._overflows - before._overflows),
+			(unsigned int)(after._shrinks - before._shrinks),
+			(unsigned int)(after._idleReleased - before._idleReleased), (unsigned int)acquires);
+	}
+	CentralCache::GetInstance()->ResetLockStats();
+}
+
+//أnworks̸߳ÿnobjs48ֽڵĶȫͷţظrounds֣
+//ԱȼһObjectPoolConcurrentObjectPoolͷţԼnew/delete
+struct PoolBenchNode
+{
+	size_t _a, _b, _c, _d, _e, _f;
+	PoolBenchNode(size_t a = 0)
+		:_a(a), _b(a), _c(a), _d(a), _e(a), _f(a)
+	{}
+};
+
+template<class Body>
+static uint64_t RunPoolThreads(size_t nworks, Body body)
+{
+	std::vector<std::thread> vthread;
+	uint64_t begin = NowNs();
+	for (size_t k = 0; k < nworks; k++)
+	{
+		vthread.emplace_back(body);
+	}
+	for (auto& t : vthread)
+	{
+		t.join();
+	}
+	return NowNs() - begin;
+}
+
+void BenchmarkObjectPool(size_t nobjs, size_t rounds, size_t nworks)
+{
+	ObjectPool<PoolBenchNode> lockedPool;
+	std::mutex lockedMtx;
+	uint64_t locked = RunPoolThreads(nworks, [&]() {
+		std::vector<PoolBenchNode*> v(nobjs);
+		for (size_t r = 0; r < rounds; r++)
+		{
+			for (size_t i = 0; i < nobjs; i++)
+			{
+				std::lock_guard<std::mutex> lock(lockedMtx);
+				v[i] = lockedPool.New(i);
+			}
+			for (size_t i = 0; i < nobjs; i++)
+			{
+				std::lock_guard<std::mutex> lock(lockedMtx);
+				lockedPool.Delete(v[i]);
+			}
+		}
+	});
+
+	ConcurrentObjectPool<PoolBenchNode> pool;
+	uint64_t single = RunPoolThreads(nworks, [&]() {
+		std::vector<PoolBenchNode*> v(nobjs);
+		for (size_t r = 0; r < rounds; r++)
+		{
+			for (size_t i = 0; i < nobjs; i++)
+			{
+				v[i] = pool.New(i);
+			}
+			for (size_t i = 0; i < nobjs; i++)
+			{
+				pool.Delete(v[i]);
+			}
+		}
+	});
+	uint64_t bulk = RunPoolThreads(nworks, [&]() {
+		std::vector<PoolBenchNode*> v(nobjs);
+		for (size_t r = 0; r < rounds; r++)
+		{
+			pool.NewN(v.data(), nobjs, r);
+			pool.DeleteN(v.data(), nobjs);
+		}
+	});
+	size_t chunks = pool.Chunks();
+	pool.Trim();
+
+	uint64_t system = RunPoolThreads(nworks, [&]() {
+		std::vector<PoolBenchNode*> v(nobjs);
+		for (size_t r = 0; r < rounds; r++)
+		{
+			for (size_t i = 0; i < nobjs; i++)
+			{
+				v[i] = new PoolBenchNode(i);
+			}
+			for (size_t i = 0; i < nobjs; i++)
+			{
+				delete v[i];
+			}
+		}
+	});
+
+	double ops = 2.0 * nobjs * rounds * nworks;
+	printf("[] %ụ߳ÿͷ%u%u: ObjectPool+ %.2f Mops/sConcurrentObjectPool %.2f Mops/s"
+		" %.2f Mops/snew/delete %.2f Mops/sTrimǰ%u飬Trim%u\n",
+		(unsigned int)nworks, (unsigned int)nobjs, (unsigned int)rounds, ops * 1000 / locked, ops * 1000 / single,
+		ops * 1000 / bulk, ops * 1000 / system, (unsigned int)chunks, (unsigned int)pool.Chunks());
+}
+
+//page cacheչԣÿζͷŴ256KBĶÿһβҪpage cache
+//߳164ͳǽʱÿɵĲ
+void BenchmarkPageCacheScaling(size_t ntimes, size_t rounds)
+{
+	for (size_t nworks = 1; nworks <= 64; nworks *= 2)
+	{
+		PageCache::ResetLockStats();
+		std::vector<std::thread> vthread(nworks);
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t k = 0; k < nworks; ++k)
+		{
+			vthread[k] = std::thread([&]() {
+				std::vector<void*> v;
+				v.reserve(ntimes);
+				for (size_t j = 0; j < rounds; ++j)
+				{
+					for (size_t i = 0; i < ntimes; i++)
+					{
+						v.push_back(ConcurrentAlloc(MAX_BYTES + 1 + (i % 8) * (1 << PAGE_SHIFT)));
+					}
+					for (size_t i = 0; i < ntimes; i++)
+					{
+						ConcurrentFree(v[i]);
+					}
+					v.clear();
+				}
+			});
+		}
+		for (auto& t : vthread)
+		{
+			t.join();
+		}
+		auto end = std::chrono::steady_clock::now();
+		size_t ms = (size_t)std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+		size_t ops = 2 * nworks * rounds * ntimes;
+		size_t pageAcquires = 0, pageContended = 0;
+		PageCache::GetLockStats(pageAcquires, pageContended);
+		printf("%2ụ߳%uarena%uβʱ%u ms%u ops/msarena%u\n",
+			(unsigned int)nworks, (unsigned int)NPAGE_ARENAS, (unsigned int)ops, (unsigned int)ms,
+			(unsigned int)(ops / (ms > 0 ? ms : 1)), (unsigned int)pageContended);
+	}
+	PageCache::ResetLockStats();
+}
+
+//page cacheѡspanĲԶԱȣ4߳ͷҳһĴͷ˳Ƭ
+void BenchmarkPagePolicy(size_t ntimes, size_t rounds)
+{
+	const char* names[3] = { "best fit", "first fit", "address ordered" };
+	PagePolicy policies[3] = { PAGE_BEST_FIT, PAGE_FIRST_FIT, PAGE_ADDRESS_ORDERED };
+	for (size_t p = 0; p < 3; p++)
+	{
+		PageCache::SetPolicy(policies[p]);
+		std::vector<std::thread> vthread(4);
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t k = 0; k < 4; ++k)
+		{
+			vthread[k] = std::thread([&]() {
+				std::vector<void*> v;
+				v.reserve(ntimes);
+				for (size_t j = 0; j < rounds; ++j)
+				{
+					for (size_t i = 0; i < ntimes; i++)
+					{
+						v.push_back(ConcurrentAlloc(MAX_BYTES + 1 + (i * 7 % 64) * (1 << PAGE_SHIFT)));
+					}
+					//ͷ±꣬ͷż±
+					for (size_t i = 1; i < ntimes; i += 2)
+					{
+						ConcurrentFree(v[i]);
+					}
+					for (size_t i = 0; i < ntimes; i += 2)
+					{
+						ConcurrentFree(v[i]);
+					}
+					v.clear();
+				}
+			});
+		}
+		for (auto& t : vthread)
+		{
+			t.join();
+		}
+		auto end = std::chrono::steady_clock::now();
+		printf("[%s] 4ִ̲߳%uִΣÿִͷ%u: ѣ%u ms\n", names[p],
+			(unsigned int)rounds, (unsigned int)ntimes,
+			(unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count());
+	}
+	PageCache::SetPolicy(PAGE_BEST_FIT);
+}
+
+//2~8MBĴ黺ͷţԱȻspanÿζϵͳΪ0
+void BenchmarkLargeSpanCache(size_t ntimes, size_t nworks)
+{
+	size_t limits[2] = { PageCache::DEFAULT_LARGE_SPAN_LIMIT, 0 };
+	for (size_t limit : limits)
+	{
+		PageCache::SetLargeSpanLimit(limit);
+		std::vector<std::thread> vthread(nworks);
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t k = 0; k < nworks; ++k)
+		{
+			vthread[k] = std::thread([&]() {
+				for (size_t i = 0; i < ntimes; i++)
+				{
+					size_t bytes = (2 + i % 4 * 2) * 1024 * 1024;
+					char* p = (char*)ConcurrentAlloc(bytes);
+					p[0] = p[bytes - 1] = 1; //βҳӳڴȱҳ
+					ConcurrentFree(p);
+				}
+			});
+		}
+		for (auto& t : vthread)
+		{
+			t.join();
+		}
+		auto end = std::chrono::steady_clock::now();
+		printf("[span%uMB] %u̸߳ͷ2~8MB%u: ѣ%u ms\n",
+			(unsigned int)(limit >> 20), (unsigned int)nworks, (unsigned int)ntimes,
+			(unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count());
+	}
+	PageCache::SetLargeSpanLimit(PageCache::DEFAULT_LARGE_SPAN_LIMIT);
+}
+
+#ifdef __linux__
+//ͳƱ߳dTLBȱʧӲperf stat -e dTLB-load-misses
+//ûȨ޻вʱ-1
+static int OpenDtlbMissCounter()
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+//ҳģʽЧnobjsСnaccessΣͳƺʱdTLBȱʧRSS
+//ҳģʽҪڴ֮ǰֱ ./Benchmark hugepage  CMP_HUGEPAGE=1 ./Benchmark hugepage Ա
+void BenchmarkHugePage(size_t nobjs, size_t naccess)
+{
+#ifdef __linux__
+	size_t rssBegin = CurrentRssBytes();
+	std::vector<char*> v(nobjs);
+	for (size_t i = 0; i < nobjs; i++)
+	{
+		v[i] = (char*)ConcurrentAlloc(512);
+		memset(v[i], 0, 512);
+	}
+	size_t rssAlloc = CurrentRssBytes();
+
+	int fd = OpenDtlbMissCounter();
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	auto begin = std::chrono::steady_clock::now();
+	size_t sum = 0, x = 12345;
+	for (size_t i = 0; i < naccess; i++)
+	{
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL; //ͬ±
+		sum += v[(x >> 17) % nobjs][(x >> 7) & 511]++;
+	}
+	auto end = std::chrono::steady_clock::now();
+	long long misses = -1;
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+			misses = -1;
+		close(fd);
+	}
+
+	printf("[%s] %u512B%u: ѣ%u msdTLB-load-misses",
+		PageCache::HugePageMode() ? "ҳģʽ" : "ͨģʽ", (unsigned int)nobjs, (unsigned int)naccess,
+		(unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count());
+	if (misses >= 0)
+		printf("%lld", misses);
+	else
+		printf("");
+	printf("RSS%uMBʺ%uMB (У%u)\n", (unsigned int)((rssAlloc - rssBegin) >> 20),
+		(unsigned int)((CurrentRssBytes() - rssBegin) >> 20), (unsigned int)sum);
+
+	for (size_t i = 0; i < nobjs; i++)
+	{
+		ConcurrentFree(v[i]);
+	}
+#else
+	(void)nobjs;
+	(void)naccess;
+	printf("ҳģʽֻlinux¿\n");
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "run") == 0)
+	{
+		return RunChild(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "hugepage") == 0)
+	{
+		BenchmarkHugePage(256 * 1024, 20 * 1000 * 1000);
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "components") == 0)
+	{
+		CalibrateTimer();
+		size_t n = 10000;
+		cout << "==========================================================" <<
+			endl;
+		BenchmarkFirstTouch(); //Ҫ֮ǰܣʱspanµ
+		cout << endl << endl;
+		BenchmarkConcurrentFreePath(n, 4, 10);
+		PrintLockStats();
+		cout << endl << endl;
+		BenchmarkCpuCacheMode(n * 10);
+		cout << endl << endl;
+		BenchmarkRemoteFree(n * 50, 4);
+		cout << endl << endl;
+		BenchmarkAdaptiveLists(n * 20, 4);
+		cout << endl << endl;
+		BenchmarkObjectPool(n, 100, 4);
+		cout << endl << endl;
+		BenchmarkPageCacheScaling(n / 100, 10);
+		cout << endl << endl;
+		BenchmarkPagePolicy(n / 100, 10);
+		cout << endl << endl;
+		BenchmarkLargeSpanCache(n / 10, 4);
+		cout << "==========================================================" <<
+			endl;
+		return 0;
+	}
+	//statsstats-jsonڱConcurrentAllocһأڴصͳϢ
+	if (argc > 1 && strncmp(argv[1], "stats", 5) == 0)
+	{
+		CalibrateTimer();
+		for (const WorkloadInfo& w : WORKLOADS)
+		{
+			RunResult r = RunWorkload(w._cmp, DIST_LOGNORMAL, 4, 100000);
+			printf("%s: %.2f Mops/s\n", w._name, r._ops * 1000.0 / r._wallNs);
+		}
+		PrintLockStats();
+		cout << DumpAllocStats(strcmp(argv[1], "stats-json") == 0) << endl;
+		return 0;
+	}
+	return RunSuite(argc, argv);
+}
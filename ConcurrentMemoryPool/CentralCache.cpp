@@ -1,95 +1,149 @@
 #include "CentralCache.h"
 #include "PageCache.h"
 
-CentralCache CentralCache::_sInst;
 ObjectPool<Span> SpanList::_spanPool;
 
 //central cacheȡһĶthread cache
-size_t CentralCache::FetchRangeObj(void*& start, void*& end, size_t n, size_t size)
+size_t CentralCache::FetchRangeObj(void*& start, void*& end, size_t n, size_t size, RemoteFreeQueue* owner)
 {
 	size_t index = SizeClass::Index(size);
+
+	//仺߳ĶֱߣüͰ
+	size_t batchNum = _transferCaches[index].Remove(start, end);
+	if (batchNum != 0)
+	{
+		return batchNum;
+	}
+
 	_spanLists[index]._mtx.lock(); //
 
 	//ڶӦϣͰлȡһǿյspan
 	Span* span = GetOneSpan(_spanLists[index], size);
 	assert(span); //spanΪ
-	assert(span->_freeList); //spanеҲΪ
+	assert(span->_useCount < span->_objCount); //spanлûȥĶ
+	if (owner != nullptr)
+	{
+		span->_owner.store(owner, std::memory_order_release); //ͷʱacquireԣ֤ʼõĶ
+	}
 
 	//spanлȡn
 	//nжö
-	start = span->_freeList;
-	end = span->_freeList;
-	size_t actualNum = 1;
-	while (NextObj(end)&&n - 1)
+	//ȡĶǴʻڻҳҲѾ
+	start = nullptr;
+	end = nullptr;
+	size_t actualNum = 0;
+	if (span->_freeList != nullptr)
+	{
+		start = span->_freeList;
+		end = span->_freeList;
+		actualNum = 1;
+		while (NextObj(end) && actualNum < n)
+		{
+			end = NextObj(end);
+			actualNum++;
+		}
+		span->_freeList = NextObj(end); //ȡʣµĶŵ
+	}
+	//ٴӻûйĲְַ˳УֻдȡߵĶ
+	while (actualNum < n && span->_carveNext < span->_carveEnd)
 	{
-		end = NextObj(end);
+		void* obj = span->_carveNext;
+		span->_carveNext += size;
+		if (start == nullptr)
+		{
+			start = obj;
+		}
+		else
+		{
+			NextObj(end) = obj;
+		}
+		end = obj;
 		actualNum++;
-		n--;
 	}
-	span->_freeList = NextObj(end); //ȡʣµĶŵ
 	NextObj(end) = nullptr; //ȡһıβÿ
 	span->_useCount += actualNum; //±thread cacheļ
+	_spanLists[index].Update(span); //ʹʱˣҪ
 
 	_spanLists[index]._mtx.unlock(); //
 	return actualNum;
 }
 
 //ȡһǿյspan
-Span* CentralCache::GetOneSpan(SpanList& spanList, size_t size)
+Span* CentralCache::GetOneSpan(SpanBucket& spanList, size_t size)
 {
-	//1spanListѰҷǿյspan
-	Span* it = spanList.Begin();
-	while (it != spanList.End())
+	//1ͰһʹߵķǿspanO(1)
+	Span* it = spanList.PickNonFull();
+	if (it != nullptr)
 	{
-		if (it->_freeList != nullptr)
-		{
-			return it;
-		}
-		else
-		{
-			it = it->_next;
-		}
+		return it;
 	}
 	//2spanListûзǿյspanֻpage cache
 	//Ȱcentral cacheͰͷڴ
 	spanList._mtx.unlock();
-	PageCache::GetInstance()->_pageMtx.lock();
-	Span* span = PageCache::GetInstance()->NewSpan(SizeClass::NumMovePage(size));
-	span->_isUse = true;
-	span->_objSize = size; //spanᱻгһsizeСĶ
-	PageCache::GetInstance()->_pageMtx.unlock();
+	PageCache* arena = PageCache::GetInstance(); //ǰ߳ʹõarena
+	Span* span = nullptr;
+	{
+		std::lock_guard<StatMutex> lock(arena->_pageMtx); //NewSpanϵͳʧʱ׳bad_alloclock_guard
+		span = arena->NewSpan(SizeClass::NumMovePage(size));
+		span->_isUse = true;
+		span->_objSize = size; //spanᱻгһsizeСĶ
+		PageCache::SetSpanSizeClass(span, SizeClass::Index(size) + 1); //ͷʱҳֱӲ鵽ϣͰ
+	}
 	//ȡspanҪ¼central cacheͰ
 
 	//spanĴڴʼַʹڴĴСֽ
 	char* start = (char*)(span->_pageId << PAGE_SHIFT);
 	size_t bytes = span->_n << PAGE_SHIFT;
 
-	//ѴڴгsizeСĶ
-	char* end = start + bytes;
-	//һȥββ
-	span->_freeList = start;
-	start += size;
-	void* tail = span->_freeList;
-	//β
-	while (start < end)
+	//ѴڴгɶҪдspanÿһҳһûþͰҳˣ
+	//ֻ»ûйķΧFetchRangeObjȡʱٰ˳
+	//spanֽһsizeһĲֲг
+	span->_objCount = bytes / size;
+	span->_freeList = nullptr;
+	span->_carveNext = start;
+	span->_carveEnd = start + span->_objCount * size;
+
+	//spanҵͰʹΪ0
+	spanList._mtx.lock(); //ҪҵͰʱ¼Ͱ
+	spanList.Insert(span);
+
+	return span;
+}
+
+//thread cacheһȳԷŽ仺棬Ųٻspan
+void CentralCache::InsertRange(void* start, void* end, size_t n, size_t size)
+{
+	size_t index = SizeClass::Index(size);
+	//sizeûжСֽҪͰжʵʴС
+	if (_transferCaches[index].Insert(start, end, n, SizeClass::ClassSize(index)))
 	{
-		NextObj(tail) = start;
-		tail = NextObj(tail);
-		start += size;
+		return;
 	}
-	NextObj(tail) = nullptr; //βָÿ
-	
-	//кõspanͷ嵽spanList
-	spanList._mtx.lock(); //spanзϺҪҵͰʱ¼Ͱ
-	spanList.PushFront(span);
+	ReleaseListToSpans(start, size);
+}
 
-	return span;
+//д仺еĶ󻹸span
+size_t CentralCache::FlushTransferCaches()
+{
+	size_t objs = 0;
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		void* start = nullptr;
+		void* end = nullptr;
+		while (size_t n = _transferCaches[i].Remove(start, end))
+		{
+			ReleaseListToSpans(start, SizeClass::ClassSize(i));
+			objs += n;
+		}
+	}
+	return objs;
 }
 
 //һĶ󻹸Ӧspan
 void CentralCache::ReleaseListToSpans(void* start, size_t size)
 {
 	size_t index = SizeClass::Index(size);
+	Span* emptySpans = nullptr; //ȫջصspanͰһԻpage cache
 	_spanLists[index]._mtx.lock(); //
 	while (start)
 	{
@@ -103,21 +157,59 @@ void CentralCache::ReleaseListToSpans(void* start, size_t size)
 		if (span->_useCount == 0) //˵spanȥĶȫ
 		{
 			//ʱspanͿٻոpage cachepage cacheٳȥǰҳĺϲ
+			//Ƚ_nextڱ;ͰӴ
 			_spanLists[index].Erase(span);
 			span->_freeList = nullptr; //ÿ
-			span->_next = nullptr;
+			span->_carveNext = span->_carveEnd = nullptr;
 			span->_prev = nullptr;
-
-			//ͷspanpage cacheʱʹpage cacheͿˣʱͰ
-			_spanLists[index]._mtx.unlock(); //Ͱ
-			PageCache::GetInstance()->_pageMtx.lock(); //Ӵ
-			PageCache::GetInstance()->ReleaseSpanToPageCache(span);
-			PageCache::GetInstance()->_pageMtx.unlock(); //
-			_spanLists[index]._mtx.lock(); //Ͱ
+			span->_next = emptySpans;
+			emptySpans = span;
+		}
+		else
+		{
+			_spanLists[index].Update(span); //ʹʱˣҪ
 		}
 
 		start = next;
 	}
 
 	_spanLists[index]._mtx.unlock(); //
+
+	//ͷspanpage cacheʱʹpage cacheͿˣпspanֻһδ
+	if (emptySpans != nullptr)
+	{
+		PageCache::ReleaseSpansToPageCache(emptySpans); //arena飬ÿarenaһ
+	}
+}
+
+//ͳƵindexϣͰspanҳгĶspanпеĶʹ仺еĶ
+void CentralCache::GetClassStats(size_t index, size_t& spans, size_t& pages, size_t& objs,
+	size_t& freeObjs, size_t& transferObjs)
+{
+	spans = pages = objs = freeObjs = 0;
+	SpanBucket& bucket = _spanLists[index];
+	bucket._mtx.lock();
+	bucket.GetStats(spans, pages, objs, freeObjs);
+	bucket._mtx.unlock();
+	transferObjs = _transferCaches[index].Objects();
+}
+
+//Ͱļ;֮
+void CentralCache::GetLockStats(size_t& acquires, size_t& contended)
+{
+	acquires = 0;
+	contended = 0;
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		acquires += _spanLists[i]._mtx.Acquires();
+		contended += _spanLists[i]._mtx.Contended();
+	}
+}
+
+void CentralCache::ResetLockStats()
+{
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		_spanLists[i]._mtx.ResetStats();
+	}
 }
\ No newline at end of file
@@ -2,6 +2,146 @@
 
 #include "Common.h"
 
+//仺棺ϣͰthread cacheĶ
+//һ߳ȡʱߣO(1)ɽҪҲҪspan
+class TransferCache
+{
+public:
+	//ÿϣͰ໺
+	static const size_t MAX_BATCHES = 16;
+	//ÿϣͰ໺ֽͰһͿмKBֻƻڻ̫ڴ棻
+	//ΪʱܷŽһͰԶòϴ仺
+	static const size_t MAX_CACHED_BYTES = MAX_BYTES;
+
+	//һСΪsizeĶ󣬳ֽ޷false
+	bool Insert(void* start, void* end, size_t n, size_t size)
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		if (_count == MAX_BATCHES || (_count > 0 && (_objects + n) * size > MAX_CACHED_BYTES))
+		{
+			return false;
+		}
+		_batches[_count++] = { start, end, n };
+		_objects += n;
+		return true;
+	}
+	//Ķ
+	size_t Objects()
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		return _objects;
+	}
+	//ȡһ󣨻CPUеĿ󣩣ûз0
+	size_t Remove(void*& start, void*& end)
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		if (_count == 0)
+		{
+			return 0;
+		}
+		Batch& batch = _batches[--_count];
+		start = batch._start;
+		end = batch._end;
+		_objects -= batch._n;
+		return batch._n;
+	}
+private:
+	struct Batch
+	{
+		void* _start;
+		void* _end;
+		size_t _n;
+	};
+	Batch _batches[MAX_BATCHES];
+	size_t _count = 0;
+	size_t _objects = 0; //Ķ֮
+	std::mutex _mtx;
+};
+
+//central cacheһϣͰspan
+//ȫȥspanУпжspanʹʷֵOCCUPANCY_LEVELSУ
+//_nonEmptyMask¼Щʹǿաȡspanʱһָҵʹߵķǿ
+//Ȱѿspan꣬еspanлѶջpage cache
+class SpanBucket
+{
+public:
+	static const size_t OCCUPANCY_LEVELS = 8;
+	static const size_t FULL = OCCUPANCY_LEVELS; //±
+
+	//һʹߵķspanûзnullptr
+	Span* PickNonFull()
+	{
+		if (_nonEmptyMask == 0)
+		{
+			return nullptr;
+		}
+		return _lists[HighestBit(_nonEmptyMask)].Begin();
+	}
+	//һspan
+	void Insert(Span* span)
+	{
+		span->_occupancy = LevelOf(span);
+		_lists[span->_occupancy].PushFront(span);
+		MarkNonEmpty(span->_occupancy);
+	}
+	//Ƴһspan
+	void Erase(Span* span)
+	{
+		size_t level = span->_occupancy;
+		_lists[level].Erase(span);
+		if (level != FULL && _lists[level].Empty())
+		{
+			_nonEmptyMask &= ~((uint64_t)1 << level);
+		}
+	}
+	//ͳͰspanĸҳгĶͻûȥĶҪͰ
+	void GetStats(size_t& spans, size_t& pages, size_t& objs, size_t& freeObjs)
+	{
+		for (size_t level = 0; level <= OCCUPANCY_LEVELS; level++)
+		{
+			for (Span* it = _lists[level].Begin(); it != _lists[level].End(); it = it->_next)
+			{
+				spans++;
+				pages += it->_n;
+				objs += it->_objCount;
+				freeObjs += it->_objCount - it->_useCount;
+			}
+		}
+	}
+	//span_useCount仯󣬸µʹƶӦ
+	void Update(Span* span)
+	{
+		if (LevelOf(span) != span->_occupancy)
+		{
+			Erase(span);
+			Insert(span);
+		}
+	}
+public:
+	StatMutex _mtx; //Ͱ
+private:
+	static size_t LevelOf(Span* span)
+	{
+		//жҲܻûг׼
+		if (span->_useCount == span->_objCount)
+		{
+			return FULL;
+		}
+		//пжʱ_useCount < _objCount[0, OCCUPANCY_LEVELS)
+		return span->_useCount * OCCUPANCY_LEVELS / span->_objCount;
+	}
+	void MarkNonEmpty(size_t level)
+	{
+		if (level != FULL)
+		{
+			_nonEmptyMask |= (uint64_t)1 << level;
+		}
+	}
+
+	SpanList _lists[OCCUPANCY_LEVELS + 1];
+	uint64_t _nonEmptyMask = 0;
+};
+
 //ģʽ
 class CentralCache
 {
@@ -9,24 +149,40 @@ public:
 	//ṩһȫַʵ
 	static CentralCache* GetInstance()
 	{
-		return &_sInst;
+		//һʹʱŹ죬ԭͬPageCache::Arenas
+		static CentralCache sInst;
+		return &sInst;
 	}
 
 	//central cacheȡһĶthread cache
-	size_t FetchRangeObj(void*& start, void*& end, size_t n, size_t size);
+	//ownerΪʱΪspanˣ߳ͷЩʱѹowner߳ͷģʽ
+	size_t FetchRangeObj(void*& start, void*& end, size_t n, size_t size, RemoteFreeQueue* owner = nullptr);
 
 	//ȡһǿյspan
-	Span* GetOneSpan(SpanList& spanList, size_t size);
+	Span* GetOneSpan(SpanBucket& bucket, size_t size);
 
 	//һĶ󻹸Ӧspan
 	void ReleaseListToSpans(void* start, size_t size);
+
+	//thread cacheһ[start, end]ȳԷŽ仺棬Ųٻspan
+	void InsertRange(void* start, void* end, size_t n, size_t size);
+
+	//д仺еĶ󻹸spanȫջصspan֮page cacheػصĶ
+	size_t FlushTransferCaches();
+
+	//ͳƵindexϣͰspanҳгĶspanпеĶʹ仺еĶ
+	void GetClassStats(size_t index, size_t& spans, size_t& pages, size_t& objs,
+		size_t& freeObjs, size_t& transferObjs);
+
+	//Ͱļ;֮
+	void GetLockStats(size_t& acquires, size_t& contended);
+	void ResetLockStats();
 private:
-	SpanList _spanLists[NFREELISTS];
+	SpanBucket _spanLists[NFREELISTS];
+	TransferCache _transferCaches[NFREELISTS];
 
 private:
 	CentralCache() //캯˽
 	{}
 	CentralCache(const CentralCache&) = delete; //
-
-	static CentralCache _sInst;
 };
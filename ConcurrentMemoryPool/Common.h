@@ -9,7 +9,10 @@
 #include <algorithm>
 #include <unordered_map>
 #include <atomic>
-#include "ObjectPool.h"
+#include <cstring>
+#include <cstdint>
+#include <array>
+#include <iterator>
 
 using std::cout;
 using std::endl;
@@ -17,12 +20,82 @@ using std::endl;
 //СڵMAX_BYTESthread cache
 //MAX_BYTESֱpage cacheϵͳ
 static const size_t MAX_BYTES = 256 * 1024;
-//thread cachecentral cacheϣͰıС
-static const size_t NFREELISTS = 208;
 //page cacheйϣͰĸ
 static const size_t NPAGES = 129;
+//page cacheֳɵarenaÿarenaԼ
+static const size_t NPAGE_ARENAS = 8;
 //ҳСתƫƣһҳΪ2^13Ҳ8KB
 static const size_t PAGE_SHIFT = 13;
+//һ͸ҳ2MBҳ
+static const size_t HUGE_PAGE_PAGES = ((size_t)2 << 20) >> PAGE_SHIFT;
+
+//Ĭϵsize class10%ҵƬ˷
+//[1,128]              8byte       freelist[0,16)
+//[128+1,1024]         16byte      freelist[16,72)
+//[1024+1,8*1024]      128byte     freelist[72,128)
+//[8*1024+1,64*1024]   1024byte    freelist[128,184)
+//[64*1024+1,256*1024] 8*1024byte  freelist[184,208)
+constexpr std::array<uint32_t, 208> DefaultClassSizes()
+{
+	const size_t limits[5] = { 128, 1024, 8 * 1024, 64 * 1024, 256 * 1024 }; //ÿϽ
+	const size_t aligns[5] = { 8, 16, 128, 1024, 8 * 1024 };                 //ÿĶ
+	std::array<uint32_t, 208> sizes{};
+	size_t n = 0;
+	size_t lower = 0;
+	for (size_t i = 0; i < 5; i++)
+	{
+		for (size_t bytes = lower + aligns[i]; bytes <= limits[i]; bytes += aligns[i])
+		{
+			sizes[n++] = (uint32_t)bytes;
+		}
+		lower = limits[i];
+	}
+	return sizes;
+}
+
+//size classiϣͰĶСС
+#ifdef CMP_SIZE_CLASS_TABLE
+	//SizeClassGenʵʵСֲɵıͬ
+	#include CMP_SIZE_CLASS_TABLE
+#else
+	inline constexpr std::array<uint32_t, 208> CLASS_SIZE_TABLE = DefaultClassSizes();
+#endif
+
+//thread cachecentral cacheϣͰıС
+static const size_t NFREELISTS = std::size(CLASS_SIZE_TABLE);
+
+//size classܷʹã
+//1СУһMAX_BYTESҳӳһֽڼ¼±+1254
+//21024ֽ8ֽڡ128ֽڣСҪȵ
+//3Сȡalignһҳ2ݣͰĶСalign
+//   ConcurrentAllocAlignedmalloc16ֽڶһ㣻
+//   ȼڶÿСcһСprev(prev, c]alignʱcҲalign
+constexpr bool CheckClassSizes(const uint32_t* sizes, size_t n)
+{
+	if (n == 0 || n > 254 || sizes[n - 1] != MAX_BYTES)
+	{
+		return false;
+	}
+	size_t prev = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t size = sizes[i];
+		if (size <= prev || size % (size <= 1024 ? 8 : 128) != 0)
+		{
+			return false;
+		}
+		for (size_t align = 8; align <= ((size_t)1 << PAGE_SHIFT); align <<= 1)
+		{
+			if (size / align > prev / align && size % align != 0)
+			{
+				return false;
+			}
+		}
+		prev = size;
+	}
+	return true;
+}
+static_assert(CheckClassSizes(CLASS_SIZE_TABLE.data(), NFREELISTS), "invalid size class table");
 
 #ifdef _WIN64
 	typedef unsigned long long PAGE_ID;
@@ -30,13 +103,110 @@ static const size_t PAGE_SHIFT = 13;
 	typedef size_t PAGE_ID;
 #else
 	//linux
+	typedef uintptr_t PAGE_ID;
 #endif
 
 #ifdef _WIN32
 	#include <Windows.h>
 #else
-	//...
+	#include <sys/mman.h>
+	using std::min;
+	using std::max;
+#endif
+
+#ifndef _WIN32
+//linuxµҳԴmmapԤһεַռ䣨PROT_NONEռڴ棩
+//ʹʱٰύmprotectΪɶдÿ붼һmmapϵͳ
+class SystemPageRegion
+{
+public:
+	//ÿԤĵַռС1GB
+	static const size_t RESERVE_BYTES = (size_t)1 << 30;
+
+	//alignֽڣҳС2ݱϵͳbytesֽڣʧܷnullptr
+	static void* Alloc(size_t bytes, size_t align = (size_t)1 << PAGE_SHIFT)
+	{
+		if (bytes > RESERVE_BYTES / 4) //ڴ浥ӳ䣬ռԤ
+		{
+			return MapAligned(bytes, PROT_READ | PROT_WRITE, align);
+		}
+
+		std::lock_guard<std::mutex> lock(_mtx);
+		//ʱĲֱPROT_NONEֻռַռ
+		char* cur = _cur == nullptr ? nullptr : (char*)(((uintptr_t)_cur + align - 1) & ~(uintptr_t)(align - 1));
+		if (cur == nullptr || cur > _end || (size_t)(_end - cur) < bytes) //ԤˣԤһ
+		{
+			//Ԥҳ룬ҳʱ
+			char* region = (char*)MapAligned(RESERVE_BYTES, PROT_NONE, HUGE_PAGE_PAGES << PAGE_SHIFT);
+			if (region == nullptr)
+				return nullptr;
+			//Ԥδύβֱӻϵͳ
+			if (_cur != nullptr && _cur < _end)
+				munmap(_cur, _end - _cur);
+			_cur = cur = region;
+			_end = region + RESERVE_BYTES;
+		}
+		_cur = cur;
+		//ύ
+		if (mprotect(_cur, bytes, PROT_READ | PROT_WRITE) != 0)
+			return nullptr;
+		void* ptr = _cur;
+		_cur += bytes;
+		return ptr;
+	}
+	//黹[ptr, ptr+bytes)ԤеһҲԵmunmap
+	static void Free(void* ptr, size_t bytes)
+	{
+		munmap(ptr, bytes);
+	}
+private:
+	//ӳbytesֽڲ֤ʼַalign루ٰҳ8KBmmapֻ֤4KB
+	static void* MapAligned(size_t bytes, int prot, size_t align)
+	{
+		size_t mapBytes = bytes + align;
+		char* raw = (char*)mmap(nullptr, mapBytes, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (raw == (char*)MAP_FAILED)
+			return nullptr;
+		char* ptr = (char*)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+		//õͷβĲ
+		if (ptr > raw)
+			munmap(raw, ptr - raw);
+		if (raw + mapBytes > ptr + bytes)
+			munmap(ptr + bytes, raw + mapBytes - (ptr + bytes));
+		return ptr;
+	}
+
+	static inline std::mutex _mtx;
+	static inline char* _cur = nullptr; //Ԥһδύڴʼλ
+	static inline char* _end = nullptr; //ԤĽλ
+};
+#endif
+
+//ߵλλ±꣬xΪ0
+static inline size_t HighestBit(uint64_t x)
+{
+	assert(x != 0);
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return index;
+#else
+	return 63 - __builtin_clzll(x);
 #endif
+}
+
+//͵λλ±꣬xΪ0
+static inline size_t LowestBit(uint64_t x)
+{
+	assert(x != 0);
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return index;
+#else
+	return __builtin_ctzll(x);
+#endif
+}
 
 //ֱȥ밴ҳռ
 inline static void* SystemAlloc(size_t kpage)
@@ -44,7 +214,22 @@ inline static void* SystemAlloc(size_t kpage)
 #ifdef _WIN32
 	void* ptr = VirtualAlloc(0, kpage << PAGE_SHIFT, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
 #else
-	// linuxbrk mmap
+	// linuxԤ+ύ
+	void* ptr = SystemPageRegion::Alloc(kpage << PAGE_SHIFT);
+#endif
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+//alignPagesҳkpageҳwindows²֤
+inline static void* SystemAllocAligned(size_t kpage, size_t alignPages)
+{
+#ifdef _WIN32
+	(void)alignPages;
+	void* ptr = VirtualAlloc(0, kpage << PAGE_SHIFT, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void* ptr = SystemPageRegion::Alloc(kpage << PAGE_SHIFT, alignPages << PAGE_SHIFT);
 #endif
 	if (ptr == nullptr)
 		throw std::bad_alloc();
@@ -52,12 +237,41 @@ inline static void* SystemAlloc(size_t kpage)
 }
 
 //ֱӽڴ滹
-inline static void SystemFree(void* ptr)
+inline static void SystemFree(void* ptr, size_t kpage)
+{
+#ifdef _WIN32
+	//spanܱз֡ϲһVirtualAllocص飬ʱֻܽύ
+	MEMORY_BASIC_INFORMATION info;
+	if (VirtualQuery(ptr, &info, sizeof(info)) != 0 && info.AllocationBase == ptr
+		&& info.RegionSize == (kpage << PAGE_SHIFT))
+	{
+		VirtualFree(ptr, 0, MEM_RELEASE);
+	}
+	else
+	{
+		VirtualFree(ptr, kpage << PAGE_SHIFT, MEM_DECOMMIT);
+	}
+#else
+	//linuxmunmapҪ֪
+	SystemPageRegion::Free(ptr, kpage << PAGE_SHIFT);
+#endif
+}
+
+//ҳ黹ϵͳַ֮ʻȱҳõȫҳ
+//lazyΪtrueʱlinuxMADV_FREEڴʱں˲Żգǰٴʹûȱҳ
+inline static void SystemRelease(void* ptr, size_t kpage, bool lazy)
 {
 #ifdef _WIN32
-	VirtualFree(ptr, 0, MEM_RELEASE);
+	(void)lazy;
+	VirtualAlloc(ptr, kpage << PAGE_SHIFT, MEM_RESET, PAGE_READWRITE);
 #else
-	//linuxsbrk unmmap
+	#ifdef MADV_FREE
+	if (lazy && madvise(ptr, kpage << PAGE_SHIFT, MADV_FREE) == 0)
+		return;
+	#else
+	(void)lazy;
+	#endif
+	madvise(ptr, kpage << PAGE_SHIFT, MADV_DONTNEED);
 #endif
 }
 
@@ -66,6 +280,15 @@ static void*& NextObj(void* ptr)
 	return (*(void**)ptr);
 }
 
+//ThreadCacheȵڵļ͵ڲ
+struct FreeListCounters
+{
+	size_t _misses = 0;       //Ϊգcentral cacheĴ
+	size_t _overflows = 0;    //ޣһcentral cacheĴ
+	size_t _shrinks = 0;      //ʱûõСĴ
+	size_t _idleReleased = 0; //мʱcentral cacheĶ
+};
+
 //зֺõС
 class FreeList
 {
@@ -78,7 +301,7 @@ public:
 		//ͷ
 		NextObj(obj) = _freeList;
 		_freeList = obj;
-		_size++;
+		SetSize(Size() + 1);
 	}
 	//ͷȡһ
 	void* Pop()
@@ -88,7 +311,8 @@ public:
 		//ͷɾ
 		void* obj = _freeList;
 		_freeList = NextObj(_freeList);
-		_size--;
+		SetSize(Size() - 1);
+		UpdateLowWater();
 
 		return obj;
 	}
@@ -101,12 +325,12 @@ public:
 		//ͷ
 		NextObj(end) = _freeList;
 		_freeList = start;
-		_size += n;
+		SetSize(Size() + n);
 	}
 	//ȡһηΧĶ
 	void PopRange(void*& start, void*& end, size_t n)
 	{
-		assert(n <= _size);
+		assert(n <= Size());
 
 		//ͷɾ
 		start = _freeList;
@@ -117,7 +341,8 @@ public:
 		}
 		_freeList = NextObj(end); //ָendһ
 		NextObj(end) = nullptr; //ȡһıβÿ
-		_size -= n;
+		SetSize(Size() - n);
+		UpdateLowWater();
 	}
 	bool Empty()
 	{
@@ -129,27 +354,203 @@ public:
 		return _maxSize;
 	}
 
-	size_t Size()
+	//ĴĴ_maxSize
+	int& Streak()
+	{
+		return _streak;
+	}
+
+	//һοм̳ȣʱô˵ʱһֱûõ
+	size_t LowWater() const
 	{
-		return _size;
+		return _lowWater;
+	}
+	void ResetLowWater()
+	{
+		_lowWater = Size();
+	}
+
+	//ڵļֻ߳޸ģͳʱ߳Ҳȡ
+	void AddMiss()
+	{
+		Add(_misses, 1);
+	}
+	void AddOverflow()
+	{
+		Add(_overflows, 1);
+	}
+	void AddShrink()
+	{
+		Add(_shrinks, 1);
+	}
+	void AddIdleReleased(size_t n)
+	{
+		Add(_idleReleased, n);
+	}
+	//Ѽۼӵcounters
+	void GetCounters(FreeListCounters& counters) const
+	{
+		counters._misses += _misses.load(std::memory_order_relaxed);
+		counters._overflows += _overflows.load(std::memory_order_relaxed);
+		counters._shrinks += _shrinks.load(std::memory_order_relaxed);
+		counters._idleReleased += _idleReleased.load(std::memory_order_relaxed);
+	}
+
+	//ͳʱ߳Ҳȡ
+	size_t Size() const
+	{
+		return _size.load(std::memory_order_relaxed);
 	}
 
 private:
+	//ֻ߳޸ģͨĶдɣҪԭӵĶ--д
+	void SetSize(size_t size)
+	{
+		_size.store(size, std::memory_order_relaxed);
+	}
+	void UpdateLowWater()
+	{
+		if (Size() < _lowWater)
+		{
+			_lowWater = Size();
+		}
+	}
+	static void Add(std::atomic<size_t>& counter, size_t n)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
 	void* _freeList = nullptr; //
 	size_t _maxSize = 1;
-	size_t _size = 0;
+	std::atomic<size_t> _size{ 0 };
+	int _streak = 0;
+	size_t _lowWater = 0;
+	std::atomic<size_t> _misses{ 0 };
+	std::atomic<size_t> _overflows{ 0 };
+	std::atomic<size_t> _shrinks{ 0 };
+	std::atomic<size_t> _idleReleased{ 0 };
+};
+
+//߳ͷŶУߵߣ߳ͷű߳Ķʱѹ룬
+//߳һcentral cacheʱȡߣThreadCache::SetRemoteFree
+class RemoteFreeQueue
+{
+public:
+	//ѹһ󣬶Ѿرգ߳˳ʱfalse
+	bool Push(void* obj)
+	{
+		void* head = _head.load(std::memory_order_relaxed);
+		do
+		{
+			if (head == Closed())
+			{
+				return false;
+			}
+			NextObj(obj) = head;
+		} while (!_head.compare_exchange_weak(head, obj, std::memory_order_release, std::memory_order_relaxed));
+		return true;
+	}
+
+	//ȡȫ󣬷ͷ̵ֻ߳
+	void* PopAll()
+	{
+		if (_head.load(std::memory_order_relaxed) == nullptr) //ʱǿյģԭӽ
+		{
+			return nullptr;
+		}
+		return _head.exchange(nullptr, std::memory_order_acquire);
+	}
+
+	//߳˳ʱرնвȡʣµĶ֮Pushʧ
+	void* Close()
+	{
+		return _head.exchange(Closed(), std::memory_order_acquire);
+	}
+
+	//µ̸߳ʱ´
+	void Open()
+	{
+		_head.store(nullptr, std::memory_order_relaxed);
+	}
+
+	RemoteFreeQueue* _nextIdle = nullptr; //жThreadCacheȫ
+private:
+	//رպͷֵǶĵַ
+	static void* Closed()
+	{
+		return (void*)1;
+	}
+
+	std::atomic<void*> _head{ nullptr };
+};
+
+//size classеһСthread cacheһδcentral cacheȡ޺͹ϣͰ±꣬
+//ճ8ֽڣʱһζȡȫõ
+struct SizeClassInfo
+{
+	uint32_t _size;
+	uint16_t _batch;
+	uint16_t _index;
 };
 
+//thread cacheһδcentral cacheȡ
+constexpr size_t ClassBatchSize(size_t size)
+{
+	//ԽСԽ
+	//Խ󣬼Խ
+	size_t num = MAX_BYTES / size;
+	if (num < 2)
+		num = 2;
+	if (num > 512)
+		num = 512;
+
+	return num;
+}
+
+//ɵĲұiӦС((i-1) << shift, i << shift]֮룬Ҳ(size + (1 << shift) - 1) >> shift
+template<size_t N>
+constexpr std::array<SizeClassInfo, N> MakeClassLookup(size_t shift)
+{
+	std::array<SizeClassInfo, N> table{};
+	size_t index = 0;
+	for (size_t i = 0; i < N; i++)
+	{
+		size_t bytes = i << shift; //һӦֽ
+		while (CLASS_SIZE_TABLE[index] < bytes)
+		{
+			index++;
+		}
+		size_t size = CLASS_SIZE_TABLE[index];
+		table[i] = { (uint32_t)size, (uint16_t)ClassBatchSize(size), (uint16_t)index };
+	}
+	return table;
+}
+
+//1024ֽڰ8ֽڵȲ1291KB
+inline constexpr std::array<SizeClassInfo, (1024 >> 3) + 1> SMALL_CLASS_LOOKUP = MakeClassLookup<(1024 >> 3) + 1>(3);
+//1024ֽϰ128ֽڵȲ204916KBǰ9õ
+inline constexpr std::array<SizeClassInfo, (MAX_BYTES >> 7) + 1> LARGE_CLASS_LOOKUP = MakeClassLookup<(MAX_BYTES >> 7) + 1>(7);
+
+//ϣͰ±С
+template<size_t N>
+constexpr std::array<SizeClassInfo, N> MakeClassInfo()
+{
+	std::array<SizeClassInfo, N> table{};
+	for (size_t i = 0; i < N; i++)
+	{
+		size_t size = CLASS_SIZE_TABLE[i];
+		table[i] = { (uint32_t)size, (uint16_t)ClassBatchSize(size), (uint16_t)i };
+	}
+	return table;
+}
+inline constexpr std::array<SizeClassInfo, NFREELISTS> CLASS_INFO = MakeClassInfo<NFREELISTS>();
+
 //ӳȹϵ
 class SizeClass
 {
 public:
-	//10%ҵƬ˷
-	//[1,128]              8byte       freelist[0,16)
-	//[128+1,1024]         16byte      freelist[16,72)
-	//[1024+1,8*1024]      128byte     freelist[72,128)
-	//[8*1024+1,64*1024]   1024byte    freelist[128,184)
-	//[64*1024+1,256*1024] 8*1024byte  freelist[184,208)
+	//СCLASS_SIZE_TABLEСϣͰӳSMALL_CLASS_LOOKUPLARGE_CLASS_LOOKUP
+	//Ҫж
 
 	//һд
 	//static inline size_t _RoundUp(size_t bytes, size_t alignNum)
@@ -172,105 +573,46 @@ public:
 		return ((bytes + alignNum - 1)&~(alignNum - 1));
 	}
 
-	//ȡ϶ֽ
-	static inline size_t RoundUp(size_t bytes)
+	//õbytesֽʱڵĹϣͰbytesܳMAX_BYTES
+	static inline const SizeClassInfo& Lookup(size_t bytes)
 	{
-		if (bytes <= 128)
-		{
-			return _RoundUp(bytes, 8);
-		}
-		else if (bytes <= 1024)
-		{
-			return _RoundUp(bytes, 16);
-		}
-		else if (bytes <= 8 * 1024)
-		{
-			return _RoundUp(bytes, 128);
-		}
-		else if (bytes <= 64 * 1024)
-		{
-			return _RoundUp(bytes, 1024);
-		}
-		else if (bytes <= 256 * 1024)
-		{
-			return _RoundUp(bytes, 8 * 1024);
-		}
-		else
+		assert(bytes <= MAX_BYTES);
+		if (bytes <= 1024)
 		{
-			//assert(false);
-			//return -1;
-			//256KBİҳ
-			return _RoundUp(bytes, 1 << PAGE_SHIFT);
+			return SMALL_CLASS_LOOKUP[(bytes + 7) >> 3];
 		}
+		return LARGE_CLASS_LOOKUP[(bytes + 127) >> 7];
 	}
 
-	//һд
-	//static inline size_t _Index(size_t bytes, size_t alignNum)
-	//{
-	//	size_t index = 0;
-	//	if (bytes%alignNum != 0)
-	//	{
-	//		index = bytes / alignNum;
-	//	}
-	//	else
-	//	{
-	//		index = bytes / alignNum - 1;
-	//	}
-	//	return index;
-	//}
-
-	//λд
-	static inline size_t _Index(size_t bytes, size_t alignShift)
+	//ȡ϶ֽ
+	static inline size_t RoundUp(size_t bytes)
 	{
-		return ((bytes + (1 << alignShift) - 1) >> alignShift) - 1;
+		if (bytes <= MAX_BYTES)
+		{
+			return Lookup(bytes)._size;
+		}
+		//256KBİҳ
+		return _RoundUp(bytes, 1 << PAGE_SHIFT);
 	}
 
 	//ȡӦϣͰ±
 	static inline size_t Index(size_t bytes)
 	{
-		//ÿжٸ
-		static size_t groupArray[4] = { 16, 56, 56, 56 };
-		if (bytes <= 128)
-		{
-			return _Index(bytes, 3);
-		}
-		else if (bytes <= 1024)
-		{
-			return _Index(bytes - 128, 4) + groupArray[0];
-		}
-		else if (bytes <= 8 * 1024)
-		{
-			return _Index(bytes - 1024, 7) + groupArray[0] + groupArray[1];
-		}
-		else if (bytes <= 64 * 1024)
-		{
-			return _Index(bytes - 8 * 1024, 10) + groupArray[0] + groupArray[1] + groupArray[2];
-		}
-		else if (bytes <= 256 * 1024)
-		{
-			return _Index(bytes - 64 * 1024, 13) + groupArray[0] + groupArray[1] + groupArray[2] + groupArray[3];
-		}
-		else
-		{
-			assert(false);
-			return -1;
-		}
+		return Lookup(bytes)._index;
 	}
 
-	//thread cacheһδcentral cacheȡ
+	//Index㣺ɹϣͰ±õͰֽ
+	static inline size_t ClassSize(size_t index)
+	{
+		assert(index < NFREELISTS);
+		return CLASS_INFO[index]._size;
+	}
+
+	//thread cacheһδcentral cacheȡޣsizeǶĶС
 	static size_t NumMoveSize(size_t size)
 	{
 		assert(size > 0);
-
-		//ԽСԽ
-		//Խ󣬼Խ
-		int num = MAX_BYTES / size;
-		if (num < 2)
-			num = 2;
-		if (num > 512)
-			num = 512;
-
-		return num;
+		return Lookup(size)._batch;
 	}
 	//central cacheһpage cacheȡҳ
 	static size_t NumMovePage(size_t size)
@@ -286,6 +628,49 @@ public:
 	}
 };
 
+//;ͳƵĻ÷std::mutexһ
+//ֻڳʱ޸ģԲҪԭӵĶдֻrelaxedload/store̶֤߳ȡʱûݾ
+class StatMutex
+{
+public:
+	void lock()
+	{
+		bool contended = !_mtx.try_lock();
+		if (contended)
+		{
+			_mtx.lock();
+			_contended.store(_contended.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+		_acquires.store(_acquires.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	void unlock()
+	{
+		_mtx.unlock();
+	}
+	//
+	size_t Acquires() const
+	{
+		return _acquires.load(std::memory_order_relaxed);
+	}
+	//ʱѾ̳߳еĴ
+	size_t Contended() const
+	{
+		return _contended.load(std::memory_order_relaxed);
+	}
+	void ResetStats()
+	{
+		_acquires.store(0, std::memory_order_relaxed);
+		_contended.store(0, std::memory_order_relaxed);
+	}
+private:
+	std::mutex _mtx;
+	std::atomic<size_t> _acquires{ 0 };
+	std::atomic<size_t> _contended{ 0 };
+};
+
+//ObjectPoolSystemAllocNextObjҪ֮
+#include "ObjectPool.h"
+
 //ҳΪλĴڴ
 struct Span
 {
@@ -297,9 +682,20 @@ struct Span
 
 	size_t _objSize = 0;        //кõСĴС
 	size_t _useCount = 0;       //кõСڴ棬thread cacheļ
-	void* _freeList = nullptr;  //кõСڴ
+	void* _freeList = nullptr;  //Сڴ
+	//ûйĲ[_carveNext, _carveEnd)ʱŰ˳spanһдҳ
+	char* _carveNext = nullptr;
+	char* _carveEnd = nullptr;
 
 	bool _isUse = false;        //Ƿڱʹ
+	bool _isReleased = false;   //ʱҳǷѾ黹ϵͳռڴ棬ʱȱҳ
+	bool _isSampled = false;    //ǷǶѲҳĶ󣬼HeapProfiler.h
+	//һδspanȡ߶̵߳Ŀ߳ͷŶУ߳ͷģʽʱ
+	std::atomic<RemoteFreeQueue*> _owner{ nullptr };
+	uint64_t _freeTime = 0;     //page cacheпʼеʱ䣨룩
+
+	size_t _objCount = 0;       //гСܸcentral cacheʹã
+	size_t _occupancy = 0;      //central cacheϣͰʹ±
 };
 
 //ͷ˫ѭ
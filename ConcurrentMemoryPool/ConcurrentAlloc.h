@@ -2,38 +2,45 @@
 
 #include "Common.h"
 #include "ThreadCache.h"
+#include "CpuCache.h"
 #include "PageCache.h"
+#include "HeapProfiler.h"
 #include "ObjectPool.h"
 
 static void* ConcurrentAlloc(size_t size)
 {
 	if (size > MAX_BYTES) //256KBڴ
 	{
+		HeapProfiler::CheckSampling();
+		if (ShouldSample(size))
+		{
+			return HeapProfiler::SampleAllocate(size);
+		}
 		//Ҫҳ
 		size_t alignSize = SizeClass::RoundUp(size);
 		size_t kPage = alignSize >> PAGE_SHIFT;
 
 		//page cachekPageҳspan
-		PageCache::GetInstance()->_pageMtx.lock();
-		Span* span = PageCache::GetInstance()->NewSpan(kPage);
+		PageCache* arena = PageCache::GetInstance(); //ǰ߳ʹõarena
+		std::lock_guard<StatMutex> lock(arena->_pageMtx); //NewSpanϵͳʧʱ׳bad_alloclock_guard
+		Span* span = arena->NewSpan(kPage);
 		span->_objSize = size;
-		PageCache::GetInstance()->_pageMtx.unlock();
 
 		void* ptr = (void*)(span->_pageId << PAGE_SHIFT);
 		return ptr;
 	}
 	else
 	{
+		//per-CPUģʽʹõǰCPUĻ
+		if (CpuCache::Active())
+		{
+			return CpuCache::GetInstance()->Allocate(size);
+		}
 		//ͨTLSÿ߳ĻȡԼרThreadCache
 		if (pTLSThreadCache == nullptr)
 		{
-			static std::mutex tcMtx;
-			//cout << std::this_thread::get_id() <<"  "<<&tcMtx<< endl;
-			static ObjectPool<ThreadCache> tcPool;
-			tcMtx.lock();
-			//pTLSThreadCache = new ThreadCache;
-			pTLSThreadCache = tcPool.New();
-			tcMtx.unlock();
+			//߳˳ʱԶգThreadCache.cpp
+			pTLSThreadCache = ThreadCache::CreateForCurrentThread();
 		}
 		//cout << std::this_thread::get_id() << ":" << pTLSThreadCache << endl;
 
@@ -41,19 +48,154 @@ static void* ConcurrentAlloc(size_t size)
 	}
 }
 
+//С󻹸ǰ˻棺per-CPUģʽ»ǰCPUĻ棬򻹸̵߳ThreadCache
+static void DeallocateToFrontCache(void* ptr, size_t size)
+{
+	if (CpuCache::Active())
+	{
+		CpuCache::GetInstance()->Deallocate(ptr, size);
+	}
+	else
+	{
+		//ܻ߳̿ûڴͷű߳Ķ
+		//Ҳ߳˳ThreadCacheѾ֮TLSͷڴ
+		if (pTLSThreadCache == nullptr)
+		{
+			pTLSThreadCache = ThreadCache::CreateForCurrentThread();
+		}
+		//߳ͷģʽ߳Ķ󻹸
+		if (ThreadCache::RemoteFreeEnabled() && pTLSThreadCache->FreeToOwner(ptr))
+		{
+			return;
+		}
+		pTLSThreadCache->Deallocate(ptr, size);
+	}
+}
+
 static void ConcurrentFree(void* ptr)
 {
+	//С󣺰ҳŲ鵽ϣͰ±꣬Ҫspan
+	size_t index = PageCache::GetInstance()->MapObjectToSizeClass(ptr);
+	if (index != 0)
+	{
+		DeallocateToFrontCache(ptr, SizeClass::ClassSize(index - 1));
+		return;
+	}
+
 	Span* span = PageCache::GetInstance()->MapObjectToSpan(ptr);
 	size_t size = span->_objSize;
-	if (size > MAX_BYTES) //256KBڴͷ
+	if (size > MAX_BYTES || span->_isSampled) //256KBڴ򱻲Ķspanpage cache
 	{
-		PageCache::GetInstance()->_pageMtx.lock();
-		PageCache::GetInstance()->ReleaseSpanToPageCache(span);
-		PageCache::GetInstance()->_pageMtx.unlock();
+		if (span->_isSampled)
+		{
+			HeapProfiler::RecordFree(ptr);
+		}
+		PageCache* arena = PageCache::GetArena(span); //ʱڵarena
+		arena->_pageMtx.lock();
+		arena->ReleaseSpanToPageCache(span);
+		arena->_pageMtx.unlock();
 	}
 	else
 	{
-		assert(pTLSThreadCache);
-		pTLSThreadCache->Deallocate(ptr, size);
+		DeallocateToFrontCache(ptr, size);
+	}
+}
+
+//СͷţӦC++14sized operator deletesizeʱĴСһ
+//СֱsizeõϣͰȫҪҳӳ䣻ѲСǰҳĲҪҳӳ
+static void ConcurrentFree(void* ptr, size_t size)
+{
+	if (size > MAX_BYTES || HeapProfiler::EverSampled())
+	{
+		ConcurrentFree(ptr);
+	}
+	else
+	{
+		DeallocateToFrontCache(ptr, size);
+	}
+}
+
+//alignֽڶsizeֽڣalign2ݣConcurrentFree(ptr)ͷ
+static inline void* ConcurrentAllocAligned(size_t size, size_t align)
+{
+	assert(align > 0 && (align & (align - 1)) == 0);
+	if (align <= ((size_t)1 << PAGE_SHIFT))
+	{
+		//spanʼַҳ룬ͰеĶspanͷгСalignʱÿ󶼰align룻
+		//sizeȡalignͰĶСalignCheckClassSizes֤size classһ㣩
+		//256KBʱֱӰҳ䣬ͬ
+		return ConcurrentAlloc(SizeClass::_RoundUp(size, align));
+	}
+
+	//볬һҳpage cacheʼҳalignspan
+	size_t kPage = SizeClass::_RoundUp(size, (size_t)1 << PAGE_SHIFT) >> PAGE_SHIFT;
+	PageCache* arena = PageCache::GetInstance();
+	std::lock_guard<StatMutex> lock(arena->_pageMtx);
+	Span* span = arena->NewSpanAligned(kPage, align >> PAGE_SHIFT);
+	//κιϣͰspanͷʱҪߴڴ·
+	span->_objSize = size > MAX_BYTES ? size : MAX_BYTES + 1;
+
+	return (void*)(span->_pageId << PAGE_SHIFT);
+}
+
+//ptrָڴΪsizeֽڲԭݣͬreallocptrΪʱ൱룬sizeΪ0ʱͷŲؿ
+//С´СͬһͰʱԭطأڴȳpage cacheԭ̲ڵĿҳС
+//в롢ͷ
+static inline void* ConcurrentRealloc(void* ptr, size_t size)
+{
+	if (ptr == nullptr)
+	{
+		return ConcurrentAlloc(size);
+	}
+	if (size == 0)
+	{
+		ConcurrentFree(ptr);
+		return nullptr;
+	}
+
+	size_t oldSize = 0;
+	size_t index = PageCache::MapObjectToSizeClass(ptr);
+	if (index != 0)
+	{
+		if (size <= MAX_BYTES && SizeClass::Index(size) == index - 1)
+		{
+			return ptr;
+		}
+		oldSize = SizeClass::ClassSize(index - 1);
+	}
+	else
+	{
+		Span* span = PageCache::MapObjectToSpan(ptr);
+		oldSize = span->_n << PAGE_SHIFT;
+		//¼ǲʱĴСspanԭظıСʧ棬
+		//·ͷžɶʱɾɲ¶ٰµĴСǷ
+		if (size > MAX_BYTES && !span->_isSampled)
+		{
+			size_t kPage = SizeClass::RoundUp(size) >> PAGE_SHIFT;
+			PageCache* arena = PageCache::GetArena(span);
+			std::lock_guard<StatMutex> lock(arena->_pageMtx);
+			if (arena->ResizeSpan(span, kPage))
+			{
+				span->_objSize = size;
+				return ptr;
+			}
+		}
+	}
+
+	void* newPtr = ConcurrentAlloc(size);
+	memcpy(newPtr, ptr, size < oldSize ? size : oldSize);
+	ConcurrentFree(ptr);
+	return newPtr;
+}
+
+//ptrʵʿõֽСͰĴСڴspan
+static inline size_t ConcurrentUsableSize(void* ptr)
+{
+	size_t index = PageCache::MapObjectToSizeClass(ptr);
+	if (index != 0)
+	{
+		return SizeClass::ClassSize(index - 1);
 	}
+	Span* span = PageCache::MapObjectToSpan(ptr);
+	return span->_n << PAGE_SHIFT;
 }
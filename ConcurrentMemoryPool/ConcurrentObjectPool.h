@@ -0,0 +1,557 @@
+#pragma once
+
+#include "ConcurrentAlloc.h"
+#include <new>
+#include <utility>
+
+//̰߳ȫĶأBonwickmagazineSolaris slabper-CPU㣩
+//1ÿλmagazineװָĶ飩ǰĺһͷֻ֮
+//   ֻӲλ̰߳ȡģѡλ߳MAX_SLOTSʱÿ̶߳ռһλûо
+//2ˣ룩ˣͷţʱҲֿ⣨depotһĻյmagazineһλMAGAZINE_ROUNDS
+//3ֿҲûmagazineʱӿ飨chunkȡװǰmagazine
+//   ConcurrentAllocAlignedС룬ַȡڵĿ飬
+//   ¿鲻Ԥз֣ȡʱ˳УͬCentralCachespan
+//ֿMAX_DEPOT_FULLmagazineٶĶֱӻڵĿ飬еĿ黹ڴأֻһã
+//Trim()лĶ󶼻ȥ
+//
+//ObjectPoolObjectPoolڴڲѾĵطʹãڴӲ黹
+
+//̱߳ţжعã̵߳һʹöʱ䣬ѡλ
+inline size_t ObjectPoolThreadIndex()
+{
+	static std::atomic<size_t> nextIndex{ 0 };
+	static thread_local size_t index = SIZE_MAX;
+	if (index == SIZE_MAX)
+	{
+		index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+	}
+	return index;
+}
+
+//ĴС128KBҳȥͷһҳܷ64󣬰2ȡ
+constexpr size_t ObjectPoolChunkBytes(size_t objSize)
+{
+	size_t bytes = 128 * 1024;
+	while (bytes < ((size_t)1 << PAGE_SHIFT) + 64 * objSize)
+	{
+		bytes *= 2;
+	}
+	return bytes;
+}
+
+template<class T>
+class ConcurrentObjectPool
+{
+public:
+	//ÿmagazineװĶ
+	static const size_t MAGAZINE_ROUNDS = 32;
+	//magazineλĸ
+	static const size_t MAX_SLOTS = 64;
+	//ֿౣmagazine
+	static const size_t MAX_DEPOT_FULL = 16;
+	//Ķ룺ͬʱTָ
+	static const size_t OBJ_ALIGN = alignof(T) < alignof(void*) ? alignof(void*) : alignof(T);
+	//ռõָֽܷ
+	static const size_t OBJ_SIZE = ((sizeof(T) < sizeof(void*) ? sizeof(void*) : sizeof(T)) + OBJ_ALIGN - 1) / OBJ_ALIGN * OBJ_ALIGN;
+	static const size_t CHUNK_BYTES = ObjectPoolChunkBytes(OBJ_SIZE);
+
+	ConcurrentObjectPool() = default;
+	ConcurrentObjectPool(const ConcurrentObjectPool&) = delete; //
+	ConcurrentObjectPool& operator=(const ConcurrentObjectPool&) = delete;
+
+	//ͷеĿmagazineûDeleteĶ󲻻ͬObjectPool
+	~ConcurrentObjectPool()
+	{
+		for (Slot& slot : _slots)
+		{
+			FreeMagazine(slot._loaded);
+			FreeMagazine(slot._previous);
+		}
+		FreeMagazineList(_fullMags);
+		FreeMagazineList(_emptyMags);
+		FreeChunkList(_partialChunks);
+		FreeChunkList(_fullChunks);
+		if (_spareChunk != nullptr)
+		{
+			ConcurrentFree(_spareChunk);
+		}
+	}
+
+	//󣬲תTĹ캯
+	template<class... Args>
+	T* New(Args&&... args)
+	{
+		void* obj = nullptr;
+		{
+			SlotLock guard(CurrentSlot());
+			obj = Pop(guard._slot);
+		}
+		try
+		{
+			return new(obj)T(std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			FreeRaw(&obj, 1); //ʧܣڴ滹ȥ
+			throw;
+		}
+	}
+
+	//ͷŶ
+	void Delete(T* obj)
+	{
+		if (obj == nullptr)
+		{
+			return;
+		}
+		obj->~T();
+		void* raw = obj;
+		FreeRaw(&raw, 1);
+	}
+
+	//һnŵobjsУÿargs죬ֻһβλ
+	template<class... Args>
+	void NewN(T** objs, size_t n, const Args&... args)
+	{
+		{
+			SlotLock guard(CurrentSlot());
+			size_t popped = 0;
+			try
+			{
+				for (; popped < n; popped++)
+				{
+					objs[popped] = (T*)Pop(guard._slot);
+				}
+			}
+			catch (...)
+			{
+				//ʱʧܣѾȡֱӻڵĿ飨ڴ棩λguardͷ
+				std::lock_guard<std::mutex> lock(_mtx);
+				for (size_t i = 0; i < popped; i++)
+				{
+					ReturnToChunk(objs[i]);
+				}
+				throw;
+			}
+		}
+		size_t constructed = 0;
+		try
+		{
+			for (; constructed < n; constructed++)
+			{
+				new(objs[constructed])T(args...);
+			}
+		}
+		catch (...)
+		{
+			//Ѿõnڴȫȥ
+			for (size_t i = 0; i < constructed; i++)
+			{
+				objs[i]->~T();
+			}
+			FreeRaw((void* const*)objs, n);
+			throw;
+		}
+	}
+
+	//һͷobjsеnֻһβλ
+	void DeleteN(T* const* objs, size_t n)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			objs[i]->~T();
+		}
+		FreeRaw((void* const*)objs, n);
+	}
+
+	//ѸλͲֿлĶ󶼻ڵĿ飬еĿ飨õģڴ
+	void Trim()
+	{
+		for (Slot& slot : _slots)
+		{
+			SlotLock guard(&slot);
+			std::lock_guard<std::mutex> lock(_mtx);
+			DrainMagazine(slot._loaded);
+			DrainMagazine(slot._previous);
+		}
+		std::lock_guard<std::mutex> lock(_mtx);
+		while (_fullMags != nullptr)
+		{
+			Magazine* mag = _fullMags;
+			_fullMags = mag->_next;
+			DrainMagazine(mag);
+			PushMagazine(_emptyMags, mag);
+		}
+		_fullCount = 0;
+		if (_spareChunk != nullptr)
+		{
+			ConcurrentFree(_spareChunk);
+			_spareChunk = nullptr;
+			_chunkCount--;
+		}
+	}
+
+	//ǰеĿõģ
+	size_t Chunks()
+	{
+		std::lock_guard<std::mutex> lock(_mtx);
+		return _chunkCount;
+	}
+
+private:
+	struct Magazine
+	{
+		size_t _rounds = 0;
+		void* _objs[MAGAZINE_ROUNDS];
+		Magazine* _next = nullptr; //ڲֿʱ
+	};
+
+	//ж룬ⲻ̵ͬ߳Ĳλ֮α
+	struct alignas(64) Slot
+	{
+		std::atomic_flag _lock = ATOMIC_FLAG_INIT;
+		Magazine* _loaded = nullptr;   //ǰmagazine
+		Magazine* _previous = nullptr; //һmagazineȫȫգձ߽ʱÿζҲֿ
+	};
+
+	//ͷӿͷ֮ʼ
+	struct Chunk
+	{
+		Chunk* _prev = nullptr;
+		Chunk* _next = nullptr;
+		void* _freeList = nullptr; //Ķ
+		char* _carveNext = nullptr; //ûйĲ[_carveNext, _carveEnd)
+		char* _carveEnd = nullptr;
+		size_t _inUse = 0;         //ȡߣmagazineлʹãĶ
+	};
+
+	//һڿеƫ
+	static const size_t OBJ_OFFSET = (sizeof(Chunk) + OBJ_ALIGN - 1) / OBJ_ALIGN * OBJ_ALIGN;
+	static_assert(OBJ_ALIGN <= ((size_t)1 << PAGE_SHIFT), "ConcurrentObjectPool: alignment larger than a page");
+
+	//вλ򣬹ʱʱPopSlowʱڴ׳bad_alloc쳣ʱҲ©
+	struct SlotLock
+	{
+		explicit SlotLock(Slot* slot)
+			: _slot(slot)
+		{
+			while (_slot->_lock.test_and_set(std::memory_order_acquire))
+			{
+				std::this_thread::yield(); //MAX_SLOTS߳ʱŻͱ̹߳òλTrimҲסλ
+			}
+		}
+		~SlotLock()
+		{
+			_slot->_lock.clear(std::memory_order_release);
+		}
+		SlotLock(const SlotLock&) = delete;
+		SlotLock& operator=(const SlotLock&) = delete;
+
+		Slot* _slot;
+	};
+
+	//ǰ̵߳ĲλSlotLockܷ
+	Slot* CurrentSlot()
+	{
+		return &_slots[ObjectPoolThreadIndex() % MAX_SLOTS];
+	}
+
+	//ӲλȡһҪвλ
+	void* Pop(Slot* slot)
+	{
+		Magazine* mag = slot->_loaded;
+		if (mag != nullptr && mag->_rounds > 0)
+		{
+			return mag->_objs[--mag->_rounds];
+		}
+		return PopSlow(slot);
+	}
+
+	//ǰmagazine
+	void* PopSlow(Slot* slot)
+	{
+		//1һmagazineģ͵ǰĽ
+		if (slot->_previous != nullptr && slot->_previous->_rounds > 0)
+		{
+			std::swap(slot->_loaded, slot->_previous);
+			return slot->_loaded->_objs[--slot->_loaded->_rounds];
+		}
+		std::lock_guard<std::mutex> lock(_mtx);
+		if (_fullMags != nullptr)
+		{
+			//2ֿmagazineյһŻزֿ⣬ǰıһ
+			Magazine* full = _fullMags;
+			_fullMags = full->_next;
+			_fullCount--;
+			if (slot->_previous != nullptr)
+			{
+				PushMagazine(_emptyMags, slot->_previous);
+			}
+			slot->_previous = slot->_loaded;
+			slot->_loaded = full;
+		}
+		else
+		{
+			//3ֿҲûУӿȡװǰmagazine
+			if (slot->_loaded == nullptr)
+			{
+				slot->_loaded = TakeEmptyMagazine();
+			}
+			Magazine* mag = slot->_loaded;
+			while (mag->_rounds < MAGAZINE_ROUNDS)
+			{
+				mag->_objs[mag->_rounds++] = AllocateFromChunks();
+			}
+		}
+		return slot->_loaded->_objs[--slot->_loaded->_rounds];
+	}
+
+	//n󻹸ǰ̵߳Ĳλֻһβλ
+	void FreeRaw(void* const* objs, size_t n)
+	{
+		SlotLock guard(CurrentSlot());
+		for (size_t i = 0; i < n; i++)
+		{
+			Push(guard._slot, objs[i]);
+		}
+	}
+
+	//һŽλҪвλ
+	void Push(Slot* slot, void* obj)
+	{
+		Magazine* mag = slot->_loaded;
+		if (mag != nullptr && mag->_rounds < MAGAZINE_ROUNDS)
+		{
+			mag->_objs[mag->_rounds++] = obj;
+			return;
+		}
+		PushSlow(slot, obj);
+	}
+
+	//ǰmagazine
+	void PushSlow(Slot* slot, void* obj)
+	{
+		//1һmagazineǿյģ͵ǰĽ
+		if (slot->_previous != nullptr && slot->_previous->_rounds == 0)
+		{
+			std::swap(slot->_loaded, slot->_previous);
+		}
+		else
+		{
+			//2һֿ⣬ǰıһӲֿ⻻һյģ
+			//ȡmagazineٸĲλ벻ʱֱӻڵĿ飬ͷŲʧ
+			std::lock_guard<std::mutex> lock(_mtx);
+			Magazine* empty = nullptr;
+			try
+			{
+				empty = TakeEmptyMagazine();
+			}
+			catch (const std::bad_alloc&)
+			{
+				ReturnToChunk(obj);
+				return;
+			}
+			if (slot->_previous != nullptr)
+			{
+				PushFullMagazine(slot->_previous);
+			}
+			slot->_previous = slot->_loaded;
+			slot->_loaded = empty;
+		}
+		slot->_loaded->_objs[slot->_loaded->_rounds++] = obj;
+	}
+
+	//¶Ҫ_mtx
+
+	//magazineŽֿ⣬ֿѾ˾ͰѶ󻹸ڵĿ
+	void PushFullMagazine(Magazine* mag)
+	{
+		if (_fullCount < MAX_DEPOT_FULL)
+		{
+			PushMagazine(_fullMags, mag);
+			_fullCount++;
+		}
+		else
+		{
+			DrainMagazine(mag);
+			PushMagazine(_emptyMags, mag);
+		}
+	}
+
+	Magazine* TakeEmptyMagazine()
+	{
+		if (_emptyMags == nullptr)
+		{
+			return new(ConcurrentAlloc(sizeof(Magazine)))Magazine;
+		}
+		Magazine* mag = _emptyMags;
+		_emptyMags = mag->_next;
+		return mag;
+	}
+
+	static void PushMagazine(Magazine*& head, Magazine* mag)
+	{
+		mag->_next = head;
+		head = mag;
+	}
+
+	//magazineеĶȫڵĿ
+	void DrainMagazine(Magazine* mag)
+	{
+		if (mag == nullptr)
+		{
+			return;
+		}
+		while (mag->_rounds > 0)
+		{
+			ReturnToChunk(mag->_objs[--mag->_rounds]);
+		}
+	}
+
+	static bool Exhausted(Chunk* chunk)
+	{
+		return chunk->_freeList == nullptr && chunk->_carveNext == chunk->_carveEnd;
+	}
+
+	//пжĿȡһûĿʱ¿
+	void* AllocateFromChunks()
+	{
+		if (_partialChunks == nullptr)
+		{
+			PushChunk(_partialChunks, NewChunk());
+		}
+		Chunk* chunk = _partialChunks;
+		void* obj = nullptr;
+		if (chunk->_freeList != nullptr)
+		{
+			obj = chunk->_freeList;
+			chunk->_freeList = NextObj(obj);
+		}
+		else
+		{
+			obj = chunk->_carveNext;
+			chunk->_carveNext += OBJ_SIZE;
+		}
+		chunk->_inUse++;
+		if (Exhausted(chunk))
+		{
+			EraseChunk(_partialChunks, chunk);
+			PushChunk(_fullChunks, chunk);
+		}
+		return obj;
+	}
+
+	//󻹸ڵĿ飬ʱͷ
+	void ReturnToChunk(void* obj)
+	{
+		Chunk* chunk = (Chunk*)((uintptr_t)obj & ~(uintptr_t)(CHUNK_BYTES - 1));
+		if (Exhausted(chunk))
+		{
+			EraseChunk(_fullChunks, chunk);
+			PushChunk(_partialChunks, chunk);
+		}
+		NextObj(obj) = chunk->_freeList;
+		chunk->_freeList = obj;
+		if (--chunk->_inUse == 0)
+		{
+			EraseChunk(_partialChunks, chunk);
+			ReleaseChunk(chunk);
+		}
+	}
+
+	//¿飬бõñõ
+	Chunk* NewChunk()
+	{
+		if (_spareChunk != nullptr)
+		{
+			Chunk* chunk = _spareChunk;
+			_spareChunk = nullptr;
+			return chunk;
+		}
+		char* base = (char*)ConcurrentAllocAligned(CHUNK_BYTES, CHUNK_BYTES);
+		Chunk* chunk = new(base)Chunk;
+		chunk->_carveNext = base + OBJ_OFFSET;
+		chunk->_carveEnd = chunk->_carveNext + (CHUNK_BYTES - OBJ_OFFSET) / OBJ_SIZE * OBJ_SIZE;
+		_chunkCount++;
+		return chunk;
+	}
+
+	//еĿ飺һãڱ߽ϷͷţĻڴ
+	void ReleaseChunk(Chunk* chunk)
+	{
+		if (_spareChunk == nullptr)
+		{
+			_spareChunk = chunk;
+			return;
+		}
+		ConcurrentFree(chunk);
+		_chunkCount--;
+	}
+
+	static void PushChunk(Chunk*& head, Chunk* chunk)
+	{
+		chunk->_prev = nullptr;
+		chunk->_next = head;
+		if (head != nullptr)
+		{
+			head->_prev = chunk;
+		}
+		head = chunk;
+	}
+
+	static void EraseChunk(Chunk*& head, Chunk* chunk)
+	{
+		if (chunk->_prev != nullptr)
+		{
+			chunk->_prev->_next = chunk->_next;
+		}
+		else
+		{
+			head = chunk->_next;
+		}
+		if (chunk->_next != nullptr)
+		{
+			chunk->_next->_prev = chunk->_prev;
+		}
+		chunk->_prev = chunk->_next = nullptr;
+	}
+
+	static void FreeMagazine(Magazine* mag)
+	{
+		if (mag != nullptr)
+		{
+			ConcurrentFree(mag);
+		}
+	}
+
+	static void FreeMagazineList(Magazine* head)
+	{
+		while (head != nullptr)
+		{
+			Magazine* next = head->_next;
+			ConcurrentFree(head);
+			head = next;
+		}
+	}
+
+	static void FreeChunkList(Chunk* head)
+	{
+		while (head != nullptr)
+		{
+			Chunk* next = head->_next;
+			ConcurrentFree(head);
+			head = next;
+		}
+	}
+
+	Slot _slots[MAX_SLOTS];
+
+	std::mutex _mtx; //ֿͿ
+	Magazine* _fullMags = nullptr;
+	size_t _fullCount = 0;
+	Magazine* _emptyMags = nullptr;
+	Chunk* _partialChunks = nullptr; //пжĿ
+	Chunk* _fullChunks = nullptr;    //󶼱ȡߵĿ
+	Chunk* _spareChunk = nullptr;    //еıÿ
+	size_t _chunkCount = 0;
+};
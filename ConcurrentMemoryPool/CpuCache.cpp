@@ -0,0 +1,106 @@
+#include "CpuCache.h"
+
+#ifdef CMP_HAS_RSEQ
+	#include <sys/rseq.h>
+	#include <unistd.h>
+#endif
+
+//CMP_PER_CPU=1ʱper-CPUģʽ
+static bool InitPerCpu()
+{
+	const char* env = getenv("CMP_PER_CPU");
+	if (env != nullptr && strcmp(env, "1") == 0)
+	{
+		return CpuCache::GetInstance()->SetEnabled(true);
+	}
+	return false;
+}
+static bool perCpuEnv = InitPerCpu();
+
+//ȡǰ߳ڵCPUţrseqʱ-1
+int CpuCache::CurrentCpu()
+{
+#ifdef CMP_HAS_RSEQ
+	if (__rseq_size == 0) //glibcûΪ߳עrseqں˲ֻ֧tunableرգ
+	{
+		return -1;
+	}
+	//rseqλָ߳ƫ__rseq_offsetcpu_idں߳ÿαʱ
+	const struct rseq* rs = (const struct rseq*)((char*)__builtin_thread_pointer() + __rseq_offset);
+	int cpu = (int)__atomic_load_n(&rs->cpu_id, __ATOMIC_RELAXED);
+	return cpu < 0 ? 0 : cpu;
+#else
+	return -1;
+#endif
+}
+
+//رper-CPUģʽ
+bool CpuCache::SetEnabled(bool enable)
+{
+	if (!enable)
+	{
+		//ѾڸCPUеĶԭٴοʱʹ
+		_active.store(false, std::memory_order_relaxed);
+		return true;
+	}
+	if (CurrentCpu() < 0)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(_initMtx);
+	if (_slots == nullptr)
+	{
+#ifdef CMP_HAS_RSEQ
+		long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+		_nslots = ncpu > 0 ? (size_t)ncpu : 1;
+#else
+		_nslots = 1;
+#endif
+		size_t bytes = SizeClass::_RoundUp(sizeof(Slot) * _nslots, 1 << PAGE_SHIFT);
+		Slot* slots = (Slot*)SystemAlloc(bytes >> PAGE_SHIFT);
+		static ObjectPool<ThreadCache> cpuTcPool;
+		for (size_t i = 0; i < _nslots; i++)
+		{
+			new(&slots[i]) Slot;
+			slots[i]._cache = cpuTcPool.New();
+			ThreadCache::RegisterCache(slots[i]._cache);
+		}
+		_slots = slots;
+	}
+	_active.store(true, std::memory_order_release);
+	return true;
+}
+
+//صǰCPUĲλλռʱȴ
+CpuCache::Slot* CpuCache::LockCurrentSlot()
+{
+	for (;;)
+	{
+		Slot* slot = &_slots[(size_t)CurrentCpu() % _nslots];
+		slot->_mtx.lock();
+		//ڼܱǨƵ˱CPUʱCPUĲλÿλֻһCPUʹ
+		if (slot == &_slots[(size_t)CurrentCpu() % _nslots])
+		{
+			return slot;
+		}
+		slot->_mtx.unlock();
+	}
+}
+
+//ڴ
+void* CpuCache::Allocate(size_t size)
+{
+	Slot* slot = LockCurrentSlot();
+	//central cacheʱ׳bad_alloclock_guardͷŲλ
+	std::lock_guard<std::mutex> lock(slot->_mtx, std::adopt_lock);
+	return slot->_cache->Allocate(size);
+}
+
+//ͷڴ
+void CpuCache::Deallocate(void* ptr, size_t size)
+{
+	Slot* slot = LockCurrentSlot();
+	std::lock_guard<std::mutex> lock(slot->_mtx, std::adopt_lock);
+	slot->_cache->Deallocate(ptr, size);
+}
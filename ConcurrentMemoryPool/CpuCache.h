@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Common.h"
+#include "ThreadCache.h"
+
+#if defined(__linux__) && defined(__has_include)
+	#if __has_include(<sys/rseq.h>)
+		#define CMP_HAS_RSEQ 1
+	#endif
+#endif
+
+//per-CPU棺ÿCPUһThreadCacheĸ߳
+//̲߳ٸԶڻһ
+//CPUȡںͨrseqά߳˽еcpu_idȡֻһڴʣ
+//ûʹrseqٽtcmallocûдĿУռǨʱںͷִУȫ
+//ֻrseqõCPUţ߳ȡźԿܱǨƣÿCPUĻ滹һѻûо
+//ΪʱҪcentral cachepage cache䣬û߳˯ߵȴת
+//ģʽ
+class CpuCache
+{
+public:
+	//ṩһȫַʵ
+	static CpuCache* GetInstance()
+	{
+		//һʹʱŹ죬ԭͬPageCache::Arenas
+		static CpuCache sInst;
+		return &sInst;
+	}
+
+	//ǰǷper-CPUģʽͷŵĿ·ֻһж
+	static bool Active()
+	{
+		return _active.load(std::memory_order_relaxed);
+	}
+
+	//رper-CPUģʽrseqʱʧܷfalseʹÿ̵߳ThreadCache
+	bool SetEnabled(bool enable);
+
+	//ڴ
+	void* Allocate(size_t size);
+
+	//ͷڴ
+	void Deallocate(void* ptr, size_t size);
+
+	//per-CPUĸCPU
+	size_t NumCaches()
+	{
+		return _nslots;
+	}
+private:
+	//ÿCPUһλж룬ⲻͬCPU֮α
+	struct alignas(64) Slot
+	{
+		std::mutex _mtx;
+		ThreadCache* _cache = nullptr;
+	};
+
+	//ȡǰ߳ڵCPUţrseqʱ-1
+	static int CurrentCpu();
+
+	//صǰCPUĲλstd::adopt_locklock_guard
+	Slot* LockCurrentSlot();
+
+	Slot* _slots = nullptr;
+	size_t _nslots = 0;
+	std::mutex _initMtx; //ֻڿper-CPUģʽʱʹ
+
+	static inline std::atomic<bool> _active{ false };
+
+	CpuCache() = default; //캯˽
+	CpuCache(const CpuCache&) = delete; //
+};
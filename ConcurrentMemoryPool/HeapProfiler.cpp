@@ -0,0 +1,371 @@
+#include "HeapProfiler.h"
+#include "PageCache.h"
+#include <cmath>
+#include <cstdio>
+#include <map>
+
+#ifndef _WIN32
+	#include <execinfo.h>
+	#include <dlfcn.h>
+	#include <cxxabi.h>
+#endif
+
+#ifdef _WIN32
+_declspec(thread) size_t tlsBytesUntilSample = 0;
+static _declspec(thread) size_t tlsSampleEpoch = 0;
+static _declspec(thread) uint64_t tlsSampleRng = 0;
+#else
+__thread size_t tlsBytesUntilSample __attribute__((tls_model("initial-exec"))) = 0;
+static __thread size_t tlsSampleEpoch __attribute__((tls_model("initial-exec"))) = 0;
+static __thread uint64_t tlsSampleRng __attribute__((tls_model("initial-exec"))) = 0;
+#endif
+
+//һĶ
+struct HeapSample
+{
+	void* _ptr;
+	size_t _size;                             //ֽ
+	size_t _interval;                         //ʱƽڹֽ
+	int _depth;
+	void* _stack[HeapProfiler::MAX_DEPTH];
+	uint32_t _next;                           //ϣеһ±10ʾû
+};
+
+//̶С飬ַϣ±괮
+//ȫʼľ̬ݣҪ죬Ҳڼ¼ʱȥڴ
+static const size_t SAMPLE_BUCKETS = 4096;
+static HeapSample samples[HeapProfiler::MAX_SAMPLES];
+static uint32_t sampleBuckets[SAMPLE_BUCKETS]; //±1
+static uint32_t freeSampleHead = 0;            //յı±1
+static uint32_t usedSamples = 0;               //samplesùı
+static size_t liveSamples = 0;
+static size_t droppedSamples = 0;
+static std::mutex sampleMtx;
+
+static size_t SampleBucket(void* ptr)
+{
+	return (size_t)(((uintptr_t)ptr >> PAGE_SHIFT) * 0x9E3779B97F4A7C15ull >> 32) % SAMPLE_BUCKETS;
+}
+
+//xorshift64*ÿ߳һ״̬
+static uint64_t NextRandom()
+{
+	if (tlsSampleRng == 0)
+	{
+		tlsSampleRng = (uint64_t)(uintptr_t)&tlsSampleRng ^ (uint64_t)time(nullptr) ^ 0x2545F4914F6CDD1Dull;
+	}
+	tlsSampleRng ^= tlsSampleRng >> 12;
+	tlsSampleRng ^= tlsSampleRng << 25;
+	tlsSampleRng ^= tlsSampleRng >> 27;
+	return tlsSampleRng * 0x2545F4914F6CDD1Dull;
+}
+
+//ֵΪintervalļηֲѡȡһβǰҪֽ
+static size_t NextSampleBytes(size_t interval)
+{
+	//u(0, 1]Ͼȷֲ
+	double u = ((NextRandom() >> 11) + 1) * (1.0 / 9007199254740992.0);
+	double bytes = -std::log(u) * (double)interval;
+	return bytes < 1.0 ? 1 : (size_t)bytes;
+}
+
+//¼ǰĵջskip
+static int CaptureStack(void** stack, int skip)
+{
+#ifdef _WIN32
+	return (int)CaptureStackBackTrace((DWORD)skip, HeapProfiler::MAX_DEPTH, stack, nullptr);
+#else
+	void* frames[HeapProfiler::MAX_DEPTH + 4];
+	int n = backtrace(frames, HeapProfiler::MAX_DEPTH + skip);
+	int depth = n > skip ? n - skip : 0;
+	memcpy(stack, frames + (n - depth), depth * sizeof(void*));
+	return depth;
+#endif
+}
+
+//ƽÿֽڲһΣ0رղ
+void HeapProfiler::SetSampleInterval(size_t bytes)
+{
+	if (bytes != 0)
+	{
+		_everSampled.store(true, std::memory_order_relaxed);
+#ifndef _WIN32
+		//glibcһεbacktraceʱlibgcc_sڴ棬һΣҪڲ·
+		void* frames[1];
+		backtrace(frames, 1);
+#endif
+	}
+	_interval.store(bytes, std::memory_order_relaxed);
+	_epoch.fetch_add(1, std::memory_order_relaxed);
+	//ǰ̰߳µļʼ߳һ·Ϸ
+	RestartSampling();
+}
+
+//ǰ̵߳Ĳ꣨޸ĹʱãǷҪ
+bool HeapProfiler::RestartSampling()
+{
+	size_t epoch = _epoch.load(std::memory_order_relaxed);
+	//ձ޸ģ̵߳һ룩ʱֻǿʼ
+	bool expired = tlsSampleEpoch == epoch;
+	tlsSampleEpoch = epoch;
+	size_t interval = SampleInterval();
+	if (interval == 0)
+	{
+		tlsBytesUntilSample = SIZE_MAX;
+		return false;
+	}
+	tlsBytesUntilSample = NextSampleBytes(interval);
+	return expired;
+}
+
+//޸Ĺʱ¿ʼ
+void HeapProfiler::CheckSampling()
+{
+	if (tlsSampleEpoch != _epoch.load(std::memory_order_relaxed))
+	{
+		RestartSampling();
+	}
+}
+
+//ҳһĶ󣬼¼ջ
+void* HeapProfiler::SampleAllocate(size_t size)
+{
+	//ȼµջټSampleAllocateԼ
+	void* stack[MAX_DEPTH];
+	int depth = CaptureStack(stack, 1);
+
+	size_t kPage = SizeClass::_RoundUp(size, (size_t)1 << PAGE_SHIFT) >> PAGE_SHIFT;
+	PageCache* arena = PageCache::GetInstance();
+	Span* span = nullptr;
+	{
+		std::lock_guard<StatMutex> pageLock(arena->_pageMtx); //NewSpanʧ׳bad_allocʱҲ
+		span = arena->NewSpan(kPage);
+		span->_objSize = size;
+		span->_isSampled = true;
+	}
+	void* ptr = (void*)(span->_pageId << PAGE_SHIFT);
+
+	std::lock_guard<std::mutex> lock(sampleMtx);
+	uint32_t id = 0;
+	if (freeSampleHead != 0)
+	{
+		id = freeSampleHead;
+		freeSampleHead = samples[id - 1]._next;
+	}
+	else if (usedSamples < MAX_SAMPLES)
+	{
+		id = ++usedSamples;
+	}
+	else
+	{
+		droppedSamples++;
+		return ptr;
+	}
+	HeapSample& sample = samples[id - 1];
+	sample._ptr = ptr;
+	sample._size = size;
+	sample._interval = SampleInterval();
+	sample._depth = depth;
+	memcpy(sample._stack, stack, depth * sizeof(void*));
+	size_t bucket = SampleBucket(ptr);
+	sample._next = sampleBuckets[bucket];
+	sampleBuckets[bucket] = id;
+	liveSamples++;
+	return ptr;
+}
+
+//ĶͷʱãӲɾ
+void HeapProfiler::RecordFree(void* ptr)
+{
+	std::lock_guard<std::mutex> lock(sampleMtx);
+	uint32_t* link = &sampleBuckets[SampleBucket(ptr)];
+	while (*link != 0)
+	{
+		uint32_t id = *link;
+		HeapSample& sample = samples[id - 1];
+		if (sample._ptr == ptr)
+		{
+			*link = sample._next;
+			sample._ptr = nullptr;
+			sample._next = freeSampleHead;
+			freeSampleHead = id;
+			liveSamples--;
+			return;
+		}
+		link = &sample._next;
+	}
+	//ʱûм¼Ĳ󣬱Ҳ
+}
+
+size_t HeapProfiler::LiveSamples()
+{
+	std::lock_guard<std::mutex> lock(sampleMtx);
+	return liveSamples;
+}
+
+size_t HeapProfiler::DroppedSamples()
+{
+	std::lock_guard<std::mutex> lock(sampleMtx);
+	return droppedSamples;
+}
+
+//ѻŵĲƳʽʱвʽҲڴ棬ٴβ
+static std::vector<HeapSample> CopyLiveSamples()
+{
+	std::vector<HeapSample> live;
+	live.reserve(HeapProfiler::MAX_SAMPLES);
+	std::lock_guard<std::mutex> lock(sampleMtx);
+	for (size_t i = 0; i < usedSamples; i++)
+	{
+		if (samples[i]._ptr != nullptr)
+		{
+			live.push_back(samples[i]);
+		}
+	}
+	return live;
+}
+
+//ŵĲʽgperftoolsheap profileͬheap_v2
+std::string HeapProfiler::DumpPprof()
+{
+	std::vector<HeapSample> live = CopyLiveSamples();
+	size_t totalBytes = 0;
+	for (const HeapSample& sample : live)
+	{
+		totalBytes += sample._size;
+	}
+	//pprofͷĲѲԭɹ
+	size_t interval = SampleInterval() != 0 ? SampleInterval() : DEFAULT_SAMPLE_INTERVAL;
+	if (!live.empty())
+	{
+		interval = live.back()._interval;
+	}
+
+	std::string out;
+	char buf[128];
+	snprintf(buf, sizeof(buf), "heap profile: %6zu: %8zu [%6zu: %8zu] @ heap_v2/%zu\n",
+		live.size(), totalBytes, live.size(), totalBytes, interval);
+	out += buf;
+	for (const HeapSample& sample : live)
+	{
+		snprintf(buf, sizeof(buf), "%6d: %8zu [%6d: %8zu] @", 1, sample._size, 1, sample._size);
+		out += buf;
+		for (int i = 0; i < sample._depth; i++)
+		{
+			snprintf(buf, sizeof(buf), " %p", sample._stack[i]);
+			out += buf;
+		}
+		out += "\n";
+	}
+#ifdef __linux__
+	//pprofһΰѵַӦִļͶ̬
+	out += "\nMAPPED_LIBRARIES:\n";
+	FILE* maps = fopen("/proc/self/maps", "r");
+	if (maps != nullptr)
+	{
+		char line[512];
+		while (fgets(line, sizeof(line), maps) != nullptr)
+		{
+			out += line;
+		}
+		fclose(maps);
+	}
+#endif
+	return out;
+}
+
+//һصַתɺҲʱģ+ƫơַ
+static std::string Symbolize(void* addr)
+{
+	char buf[64];
+#ifndef _WIN32
+	Dl_info info;
+	if (dladdr(addr, &info) != 0)
+	{
+		if (info.dli_sname != nullptr)
+		{
+			int status = 0;
+			char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+			std::string name = status == 0 && demangled != nullptr ? demangled : info.dli_sname;
+			free(demangled);
+			return name;
+		}
+		if (info.dli_fname != nullptr)
+		{
+			const char* base = strrchr(info.dli_fname, '/');
+			snprintf(buf, sizeof(buf), "+0x%zx", (size_t)((char*)addr - (char*)info.dli_fbase));
+			return std::string(base != nullptr ? base + 1 : info.dli_fname) + buf;
+		}
+	}
+#endif
+	snprintf(buf, sizeof(buf), "%p", addr);
+	return buf;
+}
+
+//ŵĲÿǡջ(⵽ڣֺŷָ) ֽ
+std::string HeapProfiler::DumpCollapsed()
+{
+	std::vector<HeapSample> live = CopyLiveSamples();
+	std::map<void*, std::string> names;
+	std::map<std::string, double> stacks;
+	for (const HeapSample& sample : live)
+	{
+		std::string stack;
+		for (int i = sample._depth - 1; i >= 0; i--)
+		{
+			void* addr = sample._stack[i];
+			auto it = names.find(addr);
+			if (it == names.end())
+			{
+				it = names.emplace(addr, Symbolize(addr)).first;
+			}
+			stack += it->second;
+			if (i != 0)
+			{
+				stack += ';';
+			}
+		}
+		//һsizeֽڵĶ󱻲ĸ1-exp(-size/interval)ʵĵֽ
+		double prob = 1.0 - std::exp(-(double)sample._size / (double)sample._interval);
+		stacks[stack] += (double)sample._size / prob;
+	}
+
+	std::string out;
+	char buf[32];
+	for (auto& kv : stacks)
+	{
+		snprintf(buf, sizeof(buf), " %.0f\n", kv.second);
+		out += kv.first;
+		out += buf;
+	}
+	return out;
+}
+
+//CMP_HEAP_SAMPLE_INTERVALʱCMP_HEAP_PROFILEʱ˳ǰд
+static void WriteHeapProfileAtExit()
+{
+	const char* path = getenv("CMP_HEAP_PROFILE");
+	FILE* file = path != nullptr ? fopen(path, "w") : nullptr;
+	if (file != nullptr)
+	{
+		std::string profile = HeapProfiler::DumpPprof();
+		fwrite(profile.data(), 1, profile.size(), file);
+		fclose(file);
+	}
+}
+
+static bool InitHeapProfiler()
+{
+	const char* env = getenv("CMP_HEAP_SAMPLE_INTERVAL");
+	if (env == nullptr || atoll(env) <= 0)
+	{
+		return false;
+	}
+	HeapProfiler::SetSampleInterval((size_t)atoll(env));
+	if (getenv("CMP_HEAP_PROFILE") != nullptr)
+	{
+		atexit(WriteHeapProfileAtExit);
+	}
+	return true;
+}
+static bool heapProfilerEnv = InitHeapProfiler();
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Common.h"
+#include <string>
+
+//ʽѷƽÿSampleIntervalֽڲһΣ¼ĵջ
+//ĶͷʱӱɾʱԵŵĲפڴЩõ
+//
+//ÿ߳һThreadCache::Allocateʹڴ·ÿοۼֽ
+//0ʱһεļηֲѡȡֵΪSampleIntervalͳģʽͬ
+//Ķ󵥶ҳһspanspan->_isSampledͷʱҳӳϳ
+//ҪÿͷʱÿСռһҳĬ512KBļԼ1.6%ڴ
+//
+//ûпʱSIZE_MAXĿ·ֻһμתıȽϣ
+//󣬴ССͷҲҪȲһҳӳ䣬ΪǰҳĲ
+class HeapProfiler
+{
+public:
+	//¼ĶʱµĲ
+	static const size_t MAX_SAMPLES = 4096;
+	//ÿ¼ջ֡
+	static const int MAX_DEPTH = 32;
+	//Ĭϵƽ512KB
+	static const size_t DEFAULT_SAMPLE_INTERVAL = 512 * 1024;
+
+	//ƽÿֽڲһΣ0رղѾ¼Ĳͷ
+	//CMP_HEAP_SAMPLE_INTERVALʱò
+	//ͬʱCMP_HEAP_PROFILEʱ˳ǰpprofʽĽдļ
+	static void SetSampleInterval(size_t bytes);
+	static size_t SampleInterval()
+	{
+		return _interval.load(std::memory_order_relaxed);
+	}
+
+	//Ƿܴ֮ڰҳĲ
+	static bool EverSampled()
+	{
+		return _everSampled.load(std::memory_order_relaxed);
+	}
+
+	//ǰ̵߳Ĳ꣨޸Ĺʱãѡȡһβļ
+	//ǷҪ
+	static bool RestartSampling();
+
+	//޸Ĺʱ¿ʼ·ϵãùرڼ䵹ΪSIZE_MAX̼߳ʱʼ
+	static void CheckSampling();
+
+	//ҳһĶ󣬼¼ջ
+	static void* SampleAllocate(size_t size);
+
+	//ĶͷʱãӲɾ
+	static void RecordFree(void* ptr);
+
+	//ǰ¼ĲԼʱĲ
+	static size_t LiveSamples();
+	static size_t DroppedSamples();
+
+	//ŵĲʽgperftoolsheap profileͬheap_v2ֱӽpprof
+	//pprof --text ./app heap.prof
+	static std::string DumpPprof();
+
+	//ŵĲÿǡջ(⵽ڣֺŷָ) ֱֽӽflamegraph.pl
+	static std::string DumpCollapsed();
+
+private:
+	static inline std::atomic<size_t> _interval{ 0 };
+	static inline std::atomic<size_t> _epoch{ 1 }; //ÿ޸Ĳ1
+	static inline std::atomic<bool> _everSampled{ false };
+};
+
+//߳̾һβҪֽԼӦĲ汾HeapProfiler.cpp
+#ifdef _WIN32
+extern _declspec(thread) size_t tlsBytesUntilSample;
+#else
+extern __thread size_t tlsBytesUntilSample __attribute__((tls_model("initial-exec")));
+#endif
+
+//sizeֽʱۼ̵߳ĲʱǷҪ
+static inline bool ShouldSample(size_t size)
+{
+	if (size >= tlsBytesUntilSample)
+	{
+		return HeapProfiler::RestartSampling();
+	}
+	tlsBytesUntilSample -= size;
+	return false;
+}
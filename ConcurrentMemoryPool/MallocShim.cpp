@@ -0,0 +1,380 @@
+//ConcurrentAlloc滻ϵͳmalloclibcmpmalloc.so
+//LD_PRELOAD=./libcmpmalloc.so ./app û±ĳñڴ
+//Cͷźoperator new/deleteСĺͰģ
+#include "ConcurrentAlloc.h"
+#include <new>
+#include <errno.h>
+#include <string.h>
+#include <malloc.h>
+#include <unistd.h>
+
+//ŶصģֻЩ滻
+#define CMP_EXPORT __attribute__((visibility("default")))
+
+//Сֱʧܣֹҳ
+static const size_t MAX_MALLOC_BYTES = (size_t)1 << (sizeof(void*) == 8 ? 46 : 30);
+
+//mallocķֵҪmax_align_tĶ루16ֽڣ
+//8ֽڵĶŲҪ16ֽڶͣȡ16ıͰĶСҲ16ı
+static inline size_t ShimSize(size_t size)
+{
+	if (size == 0)
+	{
+		return 1;
+	}
+	return size <= 8 ? size : SizeClass::_RoundUp(size, alignof(max_align_t));
+}
+
+//ConcurrentAllocϵͳʧʱ׳bad_allocCnoexceptģ
+//쳣ܴȥֱterminateתɿָENOMEM
+static inline void* ShimAlloc(size_t size)
+{
+	if (size > MAX_MALLOC_BYTES)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+	try
+	{
+		return ConcurrentAlloc(ShimSize(size));
+	}
+	catch (const std::bad_alloc&)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+}
+
+static inline void* ShimAllocAligned(size_t size, size_t align)
+{
+	if (size > MAX_MALLOC_BYTES || align > MAX_MALLOC_BYTES)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+	try
+	{
+		if (align <= alignof(max_align_t))
+		{
+			return ConcurrentAlloc(ShimSize(size));
+		}
+		return ConcurrentAllocAligned(size == 0 ? 1 : size, align);
+	}
+	catch (const std::bad_alloc&)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+}
+
+//ڴʧʱԭptrֲ䣬glibcһ
+static inline void* ShimRealloc(void* ptr, size_t size)
+{
+	try
+	{
+		return ConcurrentRealloc(ptr, ShimSize(size));
+	}
+	catch (const std::bad_alloc&)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+}
+
+static inline void ShimFree(void* ptr)
+{
+	if (ptr != nullptr)
+	{
+		ConcurrentFree(ptr);
+	}
+}
+
+static inline bool IsPowerOfTwo(size_t n)
+{
+	return n != 0 && (n & (n - 1)) == 0;
+}
+
+//operator newʧʱnew_handlerûnew_handlerʱ׳bad_alloc
+static void* ShimNew(size_t size)
+{
+	void* ptr = ShimAlloc(size);
+	while (ptr == nullptr)
+	{
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		handler();
+		ptr = ShimAlloc(size);
+	}
+	return ptr;
+}
+
+static void* ShimNewAligned(size_t size, size_t align)
+{
+	void* ptr = ShimAllocAligned(size, align);
+	while (ptr == nullptr)
+	{
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+		handler();
+		ptr = ShimAllocAligned(size, align);
+	}
+	return ptr;
+}
+
+//СdeleteʱShimSizeȡͷʱҲҪȡܶӦͬһͰ
+static inline void ShimDeleteSized(void* ptr, size_t size)
+{
+	if (ptr != nullptr)
+	{
+		ConcurrentFree(ptr, ShimSize(size));
+	}
+}
+
+extern "C"
+{
+
+CMP_EXPORT void* malloc(size_t size) noexcept
+{
+	return ShimAlloc(size);
+}
+
+CMP_EXPORT void free(void* ptr) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void* calloc(size_t n, size_t size) noexcept
+{
+	size_t bytes = 0;
+	if (__builtin_mul_overflow(n, size, &bytes))
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+	void* ptr = ShimAlloc(bytes);
+	if (ptr != nullptr)
+	{
+		memset(ptr, 0, bytes);
+	}
+	return ptr;
+}
+
+CMP_EXPORT void* realloc(void* ptr, size_t size) noexcept
+{
+	if (ptr == nullptr)
+	{
+		return ShimAlloc(size);
+	}
+	if (size == 0) //glibcһrealloc(ptr, 0)ͷptr
+	{
+		ShimFree(ptr);
+		return nullptr;
+	}
+	if (size > MAX_MALLOC_BYTES)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+	return ShimRealloc(ptr, size);
+}
+
+CMP_EXPORT void* reallocarray(void* ptr, size_t n, size_t size) noexcept
+{
+	size_t bytes = 0;
+	if (__builtin_mul_overflow(n, size, &bytes))
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+	return realloc(ptr, bytes);
+}
+
+CMP_EXPORT int posix_memalign(void** memptr, size_t align, size_t size) noexcept
+{
+	if (!IsPowerOfTwo(align) || align % sizeof(void*) != 0)
+	{
+		return EINVAL;
+	}
+	int savedErrno = errno; //posix_memalignֵͨ󣬲޸errno
+	void* ptr = ShimAllocAligned(size, align);
+	if (ptr == nullptr)
+	{
+		errno = savedErrno;
+		return ENOMEM;
+	}
+	*memptr = ptr;
+	return 0;
+}
+
+CMP_EXPORT void* aligned_alloc(size_t align, size_t size) noexcept
+{
+	if (!IsPowerOfTwo(align))
+	{
+		errno = EINVAL;
+		return nullptr;
+	}
+	return ShimAllocAligned(size, align);
+}
+
+CMP_EXPORT void* memalign(size_t align, size_t size) noexcept
+{
+	if (!IsPowerOfTwo(align))
+	{
+		errno = EINVAL;
+		return nullptr;
+	}
+	return ShimAllocAligned(size, align);
+}
+
+CMP_EXPORT void* valloc(size_t size) noexcept
+{
+	return ShimAllocAligned(size, (size_t)sysconf(_SC_PAGESIZE));
+}
+
+CMP_EXPORT void* pvalloc(size_t size) noexcept
+{
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	return ShimAllocAligned(SizeClass::_RoundUp(size == 0 ? 1 : size, pageSize), pageSize);
+}
+
+CMP_EXPORT size_t malloc_usable_size(void* ptr) noexcept
+{
+	return ptr == nullptr ? 0 : ConcurrentUsableSize(ptr);
+}
+
+} //extern "C"
+
+CMP_EXPORT void* operator new(size_t size)
+{
+	return ShimNew(size);
+}
+
+CMP_EXPORT void* operator new[](size_t size)
+{
+	return ShimNew(size);
+}
+
+CMP_EXPORT void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return ShimNew(size);
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+CMP_EXPORT void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return ShimNew(size);
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+CMP_EXPORT void* operator new(size_t size, std::align_val_t align)
+{
+	return ShimNewAligned(size, (size_t)align);
+}
+
+CMP_EXPORT void* operator new[](size_t size, std::align_val_t align)
+{
+	return ShimNewAligned(size, (size_t)align);
+}
+
+CMP_EXPORT void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return ShimNewAligned(size, (size_t)align);
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+CMP_EXPORT void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	try
+	{
+		return ShimNewAligned(size, (size_t)align);
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+CMP_EXPORT void operator delete(void* ptr) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete[](void* ptr) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete(void* ptr, size_t size) noexcept
+{
+	ShimDeleteSized(ptr, size);
+}
+
+CMP_EXPORT void operator delete[](void* ptr, size_t size) noexcept
+{
+	ShimDeleteSized(ptr, size);
+}
+
+//ĶСȡ˶ܰsizeͰͳһҳӳͷ
+CMP_EXPORT void operator delete(void* ptr, std::align_val_t) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+	ShimFree(ptr);
+}
+
+CMP_EXPORT void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+	ShimFree(ptr);
+}
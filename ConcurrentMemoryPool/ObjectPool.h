@@ -6,12 +6,14 @@
 //class ObjectPool
 //{};
 //ڴ
+//ڴڲѾĵطʹã̹߳ʱConcurrentObjectPool.hеConcurrentObjectPool
 template<class T>
 class ObjectPool
 {
 public:
-	//
-	T* New()
+	//󣬲תTĹ캯
+	template<class... Args>
+	T* New(Args&&... args)
 	{
 		T* obj = nullptr;
 
@@ -43,7 +45,15 @@ public:
 			_remainBytes -= objSize;
 		}
 		//λnewʾTĹ캯ʼ
-		new(obj)T;
+		//ûвʱĬϳʼԭһ㣨PageMapĽڵܴȡԼʼ
+		if constexpr (sizeof...(Args) == 0)
+		{
+			new(obj)T;
+		}
+		else
+		{
+			new(obj)T(std::forward<Args>(args)...);
+		}
 
 		return obj;
 	}
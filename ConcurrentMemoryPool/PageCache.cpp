@@ -1,97 +1,453 @@
 #include "PageCache.h"
-//#include "CentralCache.h"
+#include <chrono>
+#include <condition_variable>
+#include "CentralCache.h"
 
-PageCache PageCache::_sInst;
+std::mutex PageCache::_mapMtx;
+
+//߳ʹõarena±10ʾûз
+#ifdef _WIN32
+static _declspec(thread) size_t tlsArena = 0;
+#else
+static __thread size_t tlsArena __attribute__((tls_model("initial-exec"))) = 0;
+#endif
+static std::atomic<size_t> nextArena{ 0 };
+
+//뼶ĵʱ䣬ڼspan˶
+static uint64_t NowMs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//CMP_HUGEPAGE=1ʱҳģʽ
+static bool InitHugePageMode()
+{
+	const char* env = getenv("CMP_HUGEPAGE");
+	if (env != nullptr && strcmp(env, "1") == 0)
+	{
+		PageCache::SetHugePageMode(true);
+		return true;
+	}
+	return false;
+}
+static bool hugePageEnv = InitHugePageMode();
+
+//صǰ߳ʹõarenaһεʱת
+PageCache* PageCache::GetInstance()
+{
+	if (tlsArena == 0)
+	{
+		tlsArena = nextArena.fetch_add(1, std::memory_order_relaxed) % NPAGE_ARENAS + 1;
+	}
+	return &Arenas()[tlsArena - 1];
+}
+
+//ϵͳkҳЩҳarenaӳ
+void* PageCache::SystemAllocPages(size_t k, size_t alignPages)
+{
+	void* ptr = SystemAllocAligned(k, alignPages);
+	_mappedBytes += k << PAGE_SHIFT;
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+	if (HugePageMode() && _hugePageHint.load(std::memory_order_relaxed))
+	{
+		madvise(ptr, k << PAGE_SHIFT, MADV_HUGEPAGE); //ʾں͸ҳӳڴ
+	}
+#endif
+	PAGE_ID id = (PAGE_ID)ptr >> PAGE_SHIFT;
+	{
+		//ȷӳҳŵҶѾٺãarenaûٽҪ
+		std::lock_guard<std::mutex> lock(_mapMtx);
+		Maps()._idSpanMap.Ensure(id, k);
+		Maps()._idClassMap.Ensure(id, k);
+		Maps()._idArenaMap.Ensure(id, k);
+	}
+	//ڴҳ֮ᱻз֡ϲÿһҳҪarena
+	for (PAGE_ID i = 0; i < k; i++)
+	{
+		Maps()._idArenaMap.set(id + i, ArenaId());
+	}
+	return ptr;
+}
 
 //ȡһkҳspan
 Span* PageCache::NewSpan(size_t k)
 {
 	//assert(k > 0 && k < NPAGES);
 	assert(k > 0);
-	if (k > NPAGES - 1) //128ҳֱҶ
+	while (1)
 	{
-		void* ptr = SystemAlloc(k);
-		//Span* span = new Span;
-		Span* span = _spanPool.New();
+		//128ҳʱλͼҵkҳķǿͰ
+		if (k <= NPAGES - 1)
+		{
+			size_t i = FindSpanList(k);
+			if (i < NPAGES)
+			{
+				Span* span = _spanLists[i].Begin();
+				EraseFreeSpan(span);
+				return CarveSpan(span, k);
+			}
+		}
+		//ٵspanʵ
+		Span* large = FindLargeSpan(k);
+		if (large != nullptr)
+		{
+			EraseFreeSpan(large);
+			return CarveSpan(large, k);
+		}
+		//ߵ˵û㹻spanˣʱ룬һ128ҳ128ҳʱ
+		//ҳģʽ°2MB롢2MB룬ʣĲͬһҳмʹ
+		size_t n = k > NPAGES - 1 ? k : NPAGES - 1;
+		size_t alignPages = 1;
+		if (HugePageMode())
+		{
+			n = SizeClass::_RoundUp(n, HUGE_PAGE_PAGES);
+			alignPages = HUGE_PAGE_PAGES;
+		}
+		void* ptr = SystemAllocPages(n, alignPages);
+		//Span* bigSpan = new Span;
+		Span* bigSpan = _spanPool.New();
 
-		span->_pageId = (PAGE_ID)ptr >> PAGE_SHIFT;
+		bigSpan->_pageId = (PAGE_ID)ptr >> PAGE_SHIFT;
+		bigSpan->_n = n;
+		if (n == k) //128ҳֱ꣬ӷȥ
+		{
+			return CarveSpan(bigSpan, k);
+		}
+		//ϵͳҳûбʹռڴ棬ѹ黹spanһԴ
+		bigSpan->_isReleased = true;
+
+		PushFreeSpan(bigSpan);
+		//Һú²
+	}
+}
+
+//ѾժµĿspanͷгkҳȥʣಿ¹һ
+Span* PageCache::CarveSpan(Span* span, size_t k)
+{
+	assert(span->_n >= k);
+	Span* kSpan = span;
+	if (span->_n > k) //spankҳҪз
+	{
+		Span* nSpan = span;
+		//Span* kSpan = new Span;
+		kSpan = _spanPool.New();
+
+		//nSpanͷkҳ
+		kSpan->_pageId = nSpan->_pageId;
+		kSpan->_n = k;
+
+		nSpan->_pageId += k;
+		nSpan->_n -= k;
+		//ʣµĹҵӦӳλ
+		PushFreeSpan(nSpan);
+		//洢nSpanβҳnSpan֮ӳ䣬page cacheϲspanʱǰҳĲ
+		//_idSpanMap[nSpan->_pageId] = nSpan;
+		//_idSpanMap[nSpan->_pageId + nSpan->_n - 1] = nSpan;
+		Maps()._idSpanMap.set(nSpan->_pageId, nSpan);
+		Maps()._idSpanMap.set(nSpan->_pageId + nSpan->_n - 1, nSpan);
+	}
+
+	MapInUseSpan(kSpan);
+	//ȥspaṉΪʹУֹspanͷźϲ
+	kSpan->_isUse = true;
+
+	return kSpan;
+}
+
+//ԭذʹеspanΪkҳСʱβҳ
+//ʱֻܴӽں桢ڱarenaĿspanͷгȱٵҳfalse
+bool PageCache::ResizeSpan(Span* span, size_t k)
+{
+	assert(span->_isUse && k > 0);
+	if (k == span->_n)
+	{
+		return true;
+	}
+	if (k < span->_n)
+	{
+		Span* tail = _spanPool.New();
+		tail->_pageId = span->_pageId + k;
+		tail->_n = span->_n - k;
+		tail->_isUse = true;
 		span->_n = k;
-		//ҳspan֮ӳ
-		//_idSpanMap[span->_pageId] = span;
-		_idSpanMap.set(span->_pageId, span);
+		//Ƚ²ֵӳ䣬βͷʱǰϲŻ鵽ʹ
+		MapInUseSpan(span);
+		ReleaseSpanToPageCache(tail);
+		return true;
+	}
 
-		return span;
+	size_t need = k - span->_n;
+	PAGE_ID nextId = span->_pageId + span->_n;
+	//ҳڱarenaʱӦspanarena޸ģܷ
+	if (Maps()._idArenaMap.get(nextId) != ArenaId())
+	{
+		return false;
+	}
+	Span* next = (Span*)Maps()._idSpanMap.get(nextId);
+	if (next == nullptr || next->_isUse || next->_pageId != nextId || next->_n < need)
+	{
+		return false;
+	}
+	EraseFreeSpan(next);
+	if (next->_n == need)
+	{
+		_spanPool.Delete(next);
 	}
-	//ȼkͰûspan
-	if (!_spanLists[k].Empty())
+	else
 	{
-		Span* kSpan = _spanLists[k].PopFront();
+		next->_pageId += need;
+		next->_n -= need;
+		PushFreeSpan(next);
+		Maps()._idSpanMap.set(next->_pageId, next);
+	}
+	span->_n = k;
+	MapInUseSpan(span);
+	return true;
+}
 
+//ȥspanҳӳ
+void PageCache::MapInUseSpan(Span* span)
+{
+	if (span->_n > NPAGES - 1)
+	{
+		//128ҳspanֻᰴʼַͷţϲʱspanֻ鵽βҳ
+		Maps()._idSpanMap.set(span->_pageId, span);
+		Maps()._idSpanMap.set(span->_pageId + span->_n - 1, span);
+	}
+	else
+	{
 		//ҳspanӳ䣬central cacheСڴʱҶӦspan
-		for (PAGE_ID i = 0; i < kSpan->_n; i++)
+		for (PAGE_ID i = 0; i < span->_n; i++)
 		{
-			//_idSpanMap[kSpan->_pageId + i] = kSpan;
-			_idSpanMap.set(kSpan->_pageId + i, kSpan);
+			//_idSpanMap[span->_pageId + i] = span;
+			Maps()._idSpanMap.set(span->_pageId + i, span);
 		}
+	}
+}
 
-		return kSpan;
+//ȡһkҳʼҳalignPagesspanalignPages-1ҳٰβҳ
+Span* PageCache::NewSpanAligned(size_t k, size_t alignPages)
+{
+	assert(alignPages > 0 && (alignPages & (alignPages - 1)) == 0);
+	Span* span = NewSpan(k + alignPages - 1);
+	Span* head = nullptr;
+	Span* tail = nullptr;
+	size_t pad = (size_t)(alignPages - (span->_pageId & (alignPages - 1))) & (alignPages - 1);
+	if (pad > 0)
+	{
+		head = _spanPool.New();
+		head->_pageId = span->_pageId;
+		head->_n = pad;
+		head->_isUse = true;
+		span->_pageId += pad;
+		span->_n -= pad;
 	}
-	//һºͰûspanпԽз
-	for (size_t i = k + 1; i < NPAGES; i++)
+	if (span->_n > k)
 	{
-		if (!_spanLists[i].Empty())
-		{
-			Span* nSpan = _spanLists[i].PopFront();
-			//Span* kSpan = new Span;
-			Span* kSpan = _spanPool.New();
-
-			//nSpanͷkҳ
-			kSpan->_pageId = nSpan->_pageId;
-			kSpan->_n = k;
+		tail = _spanPool.New();
+		tail->_pageId = span->_pageId + k;
+		tail->_n = span->_n - k;
+		tail->_isUse = true;
+		span->_n = k;
+	}
+	//Ƚ²ֵӳ䣬βҳͷʱǰϲŻ鵽ʹ
+	MapInUseSpan(span);
+	if (head != nullptr)
+	{
+		ReleaseSpanToPageCache(head);
+	}
+	if (tail != nullptr)
+	{
+		ReleaseSpanToPageCache(tail);
+	}
+	return span;
+}
 
-			nSpan->_pageId += k;
-			nSpan->_n -= k;
-			//ʣµĹҵӦӳλ
-			_spanLists[nSpan->_n].PushFront(nSpan);
-			//洢nSpanβҳnSpan֮ӳ䣬page cacheϲspanʱǰҳĲ
-			//_idSpanMap[nSpan->_pageId] = nSpan;
-			//_idSpanMap[nSpan->_pageId + nSpan->_n - 1] = nSpan;
-			_idSpanMap.set(nSpan->_pageId, nSpan);
-			_idSpanMap.set(nSpan->_pageId + nSpan->_n - 1, nSpan);
+//ڴspankҳСspanҳͬʱȡַ͵ģû򷵻nullptr
+//ȡڴеspanѾ黹spanϵͳ롢ûзʹģʱҪȱҳ
+Span* PageCache::FindLargeSpan(size_t k)
+{
+	Span* released = nullptr;
+	for (Span* it = _largeSpans.Begin(); it != _largeSpans.End(); it = it->_next)
+	{
+		if (it->_n >= k) //ҳַСУһľʵ
+		{
+			if (!it->_isReleased)
+			{
+				return it;
+			}
+			if (released == nullptr)
+			{
+				released = it;
+			}
+		}
+	}
+	return released;
+}
 
-			//ҳspanӳ䣬central cacheСڴʱҶӦspan
-			for (PAGE_ID i = 0; i < kSpan->_n; i++)
+//spanлֽʱӿõspanʼϵͳ
+void PageCache::TrimLargeSpans()
+{
+	size_t limit = _largeSpanLimit.load(std::memory_order_relaxed);
+	while (_largeBytes > limit)
+	{
+		//ӿõspanʼϵͳͷŵĻϱٴ룻
+		//Ѿ黹spanռڴ棬
+		Span* span = nullptr;
+		for (Span* it = _largeSpans.Begin(); it != _largeSpans.End(); it = it->_next)
+		{
+			if (!it->_isReleased && (span == nullptr || it->_freeTime < span->_freeTime))
 			{
-				//_idSpanMap[kSpan->_pageId + i] = kSpan;
-				_idSpanMap.set(kSpan->_pageId + i, kSpan);
+				span = it;
 			}
+		}
+		EraseFreeSpan(span);
+		//εַ黹ϵͳܱarena룬ӳ
+		Maps()._idSpanMap.set(span->_pageId, nullptr);
+		Maps()._idSpanMap.set(span->_pageId + span->_n - 1, nullptr);
+		for (PAGE_ID i = 0; i < span->_n; i++)
+		{
+			Maps()._idArenaMap.set(span->_pageId + i, 0);
+		}
+		SystemFree((void*)(span->_pageId << PAGE_SHIFT), span->_n);
+		_mappedBytes -= span->_n << PAGE_SHIFT;
+		//delete span;
+		_spanPool.Delete(span);
+	}
+}
 
-			//cout << "dargon" << endl; //for test
-			return kSpan;
+//ѿspanҵӦͰУάͰķǿλͼ
+void PageCache::PushFreeSpan(Span* span)
+{
+	if (span->_n > NPAGES - 1)
+	{
+		//spanҳַС
+		Span* pos = _largeSpans.Begin();
+		while (pos != _largeSpans.End()
+			&& (pos->_n < span->_n || (pos->_n == span->_n && pos->_pageId < span->_pageId)))
+		{
+			pos = pos->_next;
+		}
+		_largeSpans.Insert(pos, span);
+		if (span->_isReleased)
+		{
+			_releasedBytes += span->_n << PAGE_SHIFT;
+		}
+		else
+		{
+			_largeBytes += span->_n << PAGE_SHIFT;
+		}
+		return;
+	}
+	if (span->_isReleased)
+	{
+		_releasedBytes += span->_n << PAGE_SHIFT;
+	}
+	SpanList& list = _spanLists[span->_n];
+	if (GetPolicy() == PAGE_ADDRESS_ORDERED)
+	{
+		//ͰڰҳŴСУͷǵַ͵span
+		Span* pos = list.Begin();
+		while (pos != list.End() && pos->_pageId < span->_pageId)
+		{
+			pos = pos->_next;
 		}
+		list.Insert(pos, span);
+	}
+	else if (span->_isReleased)
+	{
+		//Ѿ黹spanͰβȸûڴеspanٲȱҳ
+		list.Insert(list.End(), span);
+	}
+	else
+	{
+		list.PushFront(span);
 	}
-	//ߵ˵ûдҳspanˣʱһ128ҳspan
-	//Span* bigSpan = new Span;
-	Span* bigSpan = _spanPool.New();
+	_spanMask[span->_n / 64] |= (uint64_t)1 << (span->_n % 64);
+}
 
-	void* ptr = SystemAlloc(NPAGES - 1);
-	bigSpan->_pageId = (PAGE_ID)ptr >> PAGE_SHIFT;
-	bigSpan->_n = NPAGES - 1;
+//ѿspanͰժ
+void PageCache::EraseFreeSpan(Span* span)
+{
+	if (span->_isReleased)
+	{
+		_releasedBytes -= span->_n << PAGE_SHIFT;
+	}
+	if (span->_n > NPAGES - 1)
+	{
+		_largeSpans.Erase(span);
+		if (!span->_isReleased)
+		{
+			_largeBytes -= span->_n << PAGE_SHIFT;
+		}
+		return;
+	}
+	SpanList& list = _spanLists[span->_n];
+	list.Erase(span);
+	if (list.Empty())
+	{
+		_spanMask[span->_n / 64] &= ~((uint64_t)1 << (span->_n % 64));
+	}
+}
 
-	_spanLists[bigSpan->_n].PushFront(bigSpan);
+//ǰҵkҳķǿͰû򷵻NPAGES
+size_t PageCache::FindSpanList(size_t k)
+{
+	PagePolicy policy = GetPolicy();
+	if (policy == PAGE_FIRST_FIT)
+	{
+		//kҳͰǿվãȡķǿͰ
+		if (!_spanLists[k].Empty())
+		{
+			return k;
+		}
+		for (size_t w = MASK_WORDS; w-- > k / 64;)
+		{
+			if (_spanMask[w] != 0)
+			{
+				size_t i = w * 64 + HighestBit(_spanMask[w]);
+				return i >= k ? i : NPAGES;
+			}
+		}
+		return NPAGES;
+	}
 
-	//ظݹԼ
-	return NewSpan(k);
+	size_t best = NPAGES;
+	for (size_t w = k / 64; w < MASK_WORDS; w++)
+	{
+		uint64_t bits = _spanMask[w];
+		if (w == k / 64)
+		{
+			bits &= ~(uint64_t)0 << (k % 64); //εСkҳͰ
+		}
+		while (bits != 0)
+		{
+			size_t i = w * 64 + LowestBit(bits);
+			if (policy == PAGE_BEST_FIT)
+			{
+				return i; //͵λʵͰ
+			}
+			//PAGE_ADDRESS_ORDEREDȽÿͰеַ͵span
+			if (best == NPAGES || _spanLists[i].Begin()->_pageId < _spanLists[best].Begin()->_pageId)
+			{
+				best = i;
+			}
+			bits &= bits - 1;
+		}
+	}
+	return best;
 }
 
 //ȡӶspanӳ
+//Ҫ_pageMtxĶģPageMap.h
 Span* PageCache::MapObjectToSpan(void* obj)
 {
 	PAGE_ID id = (PAGE_ID)obj >> PAGE_SHIFT; //ҳ
 
 	//std::unique_lock<std::mutex> lock(_pageMtx); //ʱʱԶ
-	//auto ret = _idSpanMap.find(id);
-	//if (ret != _idSpanMap.end())
+	//auto ret = Maps()._idSpanMap.find(id);
+	//if (ret != Maps()._idSpanMap.end())
 	//{
 	//	return ret->second;
 	//}
@@ -101,35 +457,160 @@ Span* PageCache::MapObjectToSpan(void* obj)
 	//	return nullptr;
 	//}
 
-	Span* ret = (Span*)_idSpanMap.get(id);
+	Span* ret = (Span*)Maps()._idSpanMap.get(id);
 	assert(ret != nullptr);
 	return ret;
 }
 
+//¼spanÿһҳӦĹϣͰ±
+void PageCache::SetSpanSizeClass(Span* span, size_t index)
+{
+	assert(index <= NFREELISTS);
+	for (PAGE_ID i = 0; i < span->_n; i++)
+	{
+		Maps()._idClassMap.set(span->_pageId + i, (unsigned char)index);
+	}
+}
+
+//һͷŶspanspan֮_next
+void PageCache::ReleaseSpansToPageCache(Span* spans)
+{
+	//Ȱarena
+	Span* arenaSpans[NPAGE_ARENAS] = { nullptr };
+	while (spans != nullptr)
+	{
+		Span* next = spans->_next;
+		size_t i = GetArena(spans) - Arenas();
+		spans->_next = arenaSpans[i];
+		arenaSpans[i] = spans;
+		spans = next;
+	}
+	//ÿarenaһ
+	for (size_t i = 0; i < NPAGE_ARENAS; i++)
+	{
+		if (arenaSpans[i] == nullptr)
+		{
+			continue;
+		}
+		PageCache* arena = &Arenas()[i];
+		arena->_pageMtx.lock();
+		Span* cur = arenaSpans[i];
+		while (cur != nullptr)
+		{
+			Span* next = cur->_next;
+			cur->_next = nullptr;
+			arena->ReleaseSpanToPageCache(cur);
+			cur = next;
+		}
+		arena->_pageMtx.unlock();
+	}
+}
+
+//arena뷢Ĵ֮
+void PageCache::GetLockStats(size_t& acquires, size_t& contended)
+{
+	acquires = contended = 0;
+	for (size_t i = 0; i < NPAGE_ARENAS; i++)
+	{
+		acquires += Arenas()[i]._pageMtx.Acquires();
+		contended += Arenas()[i]._pageMtx.Contended();
+	}
+}
+
+//ͳarenakҳspanĸspans[k]k<NPAGESspanĸҳ
+//ϵͳֽһڴеֽѾ黹ֽ
+void PageCache::GetPageStats(size_t spans[NPAGES], size_t& largeSpans, size_t& largePages,
+	size_t& mappedBytes, size_t& freeBytes, size_t& releasedBytes)
+{
+	largeSpans = largePages = mappedBytes = freeBytes = releasedBytes = 0;
+	for (size_t i = 0; i < NPAGE_ARENAS; i++)
+	{
+		PageCache* arena = &Arenas()[i];
+		arena->_pageMtx.lock();
+		for (size_t k = 1; k < NPAGES; k++)
+		{
+			SpanList& list = arena->_spanLists[k];
+			for (Span* it = list.Begin(); it != list.End(); it = it->_next)
+			{
+				spans[k]++;
+				if (!it->_isReleased)
+				{
+					freeBytes += k << PAGE_SHIFT;
+				}
+			}
+		}
+		for (Span* it = arena->_largeSpans.Begin(); it != arena->_largeSpans.End(); it = it->_next)
+		{
+			largeSpans++;
+			largePages += it->_n;
+		}
+		freeBytes += arena->_largeBytes;
+		mappedBytes += arena->_mappedBytes;
+		releasedBytes += arena->_releasedBytes;
+		arena->_pageMtx.unlock();
+	}
+}
+
+void PageCache::ResetLockStats()
+{
+	for (size_t i = 0; i < NPAGE_ARENAS; i++)
+	{
+		Arenas()[i]._pageMtx.ResetStats();
+	}
+}
+
 //ͷſеspanصPageCacheϲڵspan
 void PageCache::ReleaseSpanToPageCache(Span* span)
 {
-	if (span->_n > NPAGES - 1) //128ҳֱͷŸ
+	//spanصpage cacheκιϣͰ
+	if (span->_objSize <= MAX_BYTES)
 	{
-		void* ptr = (void*)(span->_pageId << PAGE_SHIFT);
-		SystemFree(ptr);
-		//delete span;
-		_spanPool.Delete(span);
+		SetSpanSizeClass(span, 0);
+	}
+	span->_isSampled = false;
+	span->_owner.store(nullptr, std::memory_order_relaxed);
+	//ձʹùҳڴУ¿еʼʱ䣬ùúŻᱻ黹
+	span->_isReleased = false;
+	span->_freeTime = NowMs();
+	_freedBytes += span->_n << PAGE_SHIFT;
 
-		return;
+	CoalesceAndPush(span);
+
+	//ϲĳ128ҳspanspan̫ʱϵͳ
+	if (span->_n > NPAGES - 1)
+	{
+		TrimLargeSpans();
+	}
+	//ͷŵֽﵽֵʱ˳黹arenaùõspan
+	size_t trigger = _releaseTriggerBytes.load(std::memory_order_relaxed);
+	if (trigger != 0 && _freedBytes >= trigger)
+	{
+		_freedBytes = 0;
+		ReleaseIdleSpans(_releaseAgeMs.load(std::memory_order_relaxed), HugePageMode());
 	}
+}
+
+//ǰڵĿspanϲֻϲ黹״̬ͬspan
+void PageCache::CoalesceAndPush(Span* span)
+{
 	//spanǰҳԽкϲڴƬ
 	//1ǰϲ
 	while (1)
 	{
 		PAGE_ID prevId = span->_pageId - 1;
-		//auto ret = _idSpanMap.find(prevId);
+		//ǰҳڱarenaδϵͳ룩ֹͣǰϲ
+		//ֻбarenaҳŻڱarena±޸ģжܷͨʶӦspan
+		if (Maps()._idArenaMap.get(prevId) != ArenaId())
+		{
+			break;
+		}
+		//auto ret = Maps()._idSpanMap.find(prevId);
 		////ǰҳûУδϵͳ룩ֹͣǰϲ
-		//if (ret == _idSpanMap.end())
+		//if (ret == Maps()._idSpanMap.end())
 		//{
 		//	break;
 		//}
-		Span* ret = (Span*)_idSpanMap.get(prevId);
+		Span* ret = (Span*)Maps()._idSpanMap.get(prevId);
 		if (ret == nullptr)
 		{
 			break;
@@ -141,17 +622,18 @@ void PageCache::ReleaseSpanToPageCache(Span* span)
 		{
 			break;
 		}
-		//ϲ128ҳspan޷йֹͣǰϲ
-		if (prevSpan->_n + span->_n > NPAGES - 1)
+		//Ѿ黹ϵͳҳͻڴеҳϲֿ¼֪Щҳʱȱҳ
+		if (prevSpan->_isReleased != span->_isReleased)
 		{
 			break;
 		}
 		//ǰϲ
 		span->_pageId = prevSpan->_pageId;
 		span->_n += prevSpan->_n;
+		span->_freeTime = std::max(span->_freeTime, prevSpan->_freeTime); //ϲһͷżʱ
 
 		//prevSpanӶӦ˫Ƴ
-		_spanLists[prevSpan->_n].Erase(prevSpan);
+		EraseFreeSpan(prevSpan);
 
 		//delete prevSpan;
 		_spanPool.Delete(prevSpan);
@@ -160,13 +642,18 @@ void PageCache::ReleaseSpanToPageCache(Span* span)
 	while (1)
 	{
 		PAGE_ID nextId = span->_pageId + span->_n;
-		//auto ret = _idSpanMap.find(nextId);
+		//ҳڱarenaֹͣϲ
+		if (Maps()._idArenaMap.get(nextId) != ArenaId())
+		{
+			break;
+		}
+		//auto ret = Maps()._idSpanMap.find(nextId);
 		////ҳûУδϵͳ룩ֹͣϲ
-		//if (ret == _idSpanMap.end())
+		//if (ret == Maps()._idSpanMap.end())
 		//{
 		//	break;
 		//}
-		Span* ret = (Span*)_idSpanMap.get(nextId);
+		Span* ret = (Span*)Maps()._idSpanMap.get(nextId);
 		if (ret == nullptr)
 		{
 			break;
@@ -178,28 +665,212 @@ void PageCache::ReleaseSpanToPageCache(Span* span)
 		{
 			break;
 		}
-		//ϲ128ҳspan޷йֹͣϲ
-		if (nextSpan->_n + span->_n > NPAGES - 1)
+		if (nextSpan->_isReleased != span->_isReleased)
 		{
 			break;
 		}
 		//ϲ
 		span->_n += nextSpan->_n;
+		span->_freeTime = std::max(span->_freeTime, nextSpan->_freeTime);
 
 		//nextSpanӶӦ˫Ƴ
-		_spanLists[nextSpan->_n].Erase(nextSpan);
+		EraseFreeSpan(nextSpan);
 
 		//delete nextSpan;
 		_spanPool.Delete(nextSpan);
 	}
 	//ϲspanҵӦ˫
-	_spanLists[span->_n].PushFront(span);
+	PushFreeSpan(span);
 	//spanβҳӳ
 	//_idSpanMap[span->_pageId] = span;
 	//_idSpanMap[span->_pageId + span->_n - 1] = span;
-	_idSpanMap.set(span->_pageId, span);
-	_idSpanMap.set(span->_pageId + span->_n - 1, span);
+	Maps()._idSpanMap.set(span->_pageId, span);
+	Maps()._idSpanMap.set(span->_pageId + span->_n - 1, span);
 
 	//spanΪδʹõ״̬
 	span->_isUse = false;
+}
+
+//ѱarenaпгageMs롢ûй黹span黹ϵͳع黹ֽ
+//wholeHugePagesΪtrueʱֻ黹spanǵ2MBҳɢҳ
+//spanаҳĲ[first, last)first >= lastʾspanûĴҳ
+static void HugePageRange(Span* span, PAGE_ID& first, PAGE_ID& last)
+{
+	first = SizeClass::_RoundUp(span->_pageId, HUGE_PAGE_PAGES);
+	last = (span->_pageId + span->_n) & ~(PAGE_ID)(HUGE_PAGE_PAGES - 1);
+}
+
+size_t PageCache::ReleaseIdleSpans(uint64_t ageMs, bool wholeHugePages)
+{
+	uint64_t now = NowMs();
+	//ȰҪ黹spanȫժ_next黹ϲ߱޸
+	//ժµspanʱΪʹУֹȴspanϲ
+	//ֻ黹Ĵҳʱҳspan֮ǰͷβֱ
+	//ÿһֶժԭһȥ
+	Span* victims = nullptr;
+	auto collect = [&](SpanList& list) {
+		Span* it = list.Begin();
+		while (it != list.End())
+		{
+			Span* next = it->_next;
+			PAGE_ID first = 0, last = 1;
+			if (wholeHugePages)
+			{
+				HugePageRange(it, first, last);
+			}
+			if (!it->_isReleased && now - it->_freeTime >= ageMs && first < last)
+			{
+				EraseFreeSpan(it);
+				it->_isUse = true;
+				it->_next = victims;
+				victims = it;
+			}
+			it = next;
+		}
+	};
+	for (size_t i = 1; i < NPAGES; i++)
+	{
+		if (_spanMask[i / 64] & ((uint64_t)1 << (i % 64)))
+		{
+			collect(_spanLists[i]);
+		}
+	}
+	collect(_largeSpans);
+
+	size_t bytes = 0;
+	while (victims != nullptr)
+	{
+		Span* span = victims;
+		victims = victims->_next;
+		if (wholeHugePages)
+		{
+			//spanаҳĲ[first, last)ժʱѾ֤ǿ
+			PAGE_ID first = 0, last = 0;
+			HugePageRange(span, first, last);
+			assert(first < last);
+			//Ѵҳ֮ͷβȻΪûй黹spanһ
+			if (first > span->_pageId)
+			{
+				Span* head = _spanPool.New();
+				head->_pageId = span->_pageId;
+				head->_n = first - span->_pageId;
+				head->_freeTime = span->_freeTime;
+				span->_pageId = first;
+				span->_n -= head->_n;
+				CoalesceAndPush(head);
+			}
+			if (last < span->_pageId + span->_n)
+			{
+				Span* tail = _spanPool.New();
+				tail->_pageId = last;
+				tail->_n = span->_pageId + span->_n - last;
+				tail->_freeTime = span->_freeTime;
+				span->_n -= tail->_n;
+				CoalesceAndPush(tail);
+			}
+		}
+		SystemRelease((void*)(span->_pageId << PAGE_SHIFT), span->_n,
+			_releaseLazily.load(std::memory_order_relaxed));
+		bytes += span->_n << PAGE_SHIFT;
+		span->_isReleased = true;
+		span->_isUse = false;
+		//黹spanԺڵѹ黹spanϲ
+		CoalesceAndPush(span);
+	}
+	return bytes;
+}
+
+//黹arenaȫеspanع黹ֽ
+size_t PageCache::ReleaseFreeMemory()
+{
+	//仺еĶȻspanȫеspanһ黹
+	//ReleaseListToSpansarena֮ǰ
+	CentralCache::GetInstance()->FlushTransferCaches();
+
+	size_t bytes = 0;
+	for (size_t i = 0; i < NPAGE_ARENAS; i++)
+	{
+		PageCache* arena = &Arenas()[i];
+		arena->_pageMtx.lock();
+		bytes += arena->ReleaseIdleSpans(0, false); //ʽ黹ʱҳҲԲɢ
+		arena->_freedBytes = 0;
+		arena->_pageMtx.unlock();
+	}
+	return bytes;
+}
+
+//arenaѾ黹ϵͳԸõĿֽ
+size_t PageCache::ReleasedBytes()
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < NPAGE_ARENAS; i++)
+	{
+		Arenas()[i]._pageMtx.lock();
+		bytes += Arenas()[i]._releasedBytes;
+		Arenas()[i]._pageMtx.unlock();
+	}
+	return bytes;
+}
+
+//̨黹̵߳״̬һʱҲͷţ
+//˳ʱܻ߳̿ڵȴõȱ
+struct BackgroundRelease
+{
+	std::condition_variable _cond;
+	std::thread _thread;
+	bool _stop = false;
+};
+static std::mutex releaseMtx;
+static BackgroundRelease* bgRelease = nullptr;
+
+//̨̣߳ÿintervalMs黹arenaùõspanѾʱfalse
+bool PageCache::StartBackgroundRelease(size_t intervalMs)
+{
+	std::lock_guard<std::mutex> lock(releaseMtx);
+	if (bgRelease == nullptr)
+	{
+		bgRelease = new BackgroundRelease;
+	}
+	if (bgRelease->_thread.joinable())
+	{
+		return false;
+	}
+	bgRelease->_stop = false;
+	bgRelease->_thread = std::thread([intervalMs]() {
+		std::unique_lock<std::mutex> lock(releaseMtx);
+		while (!bgRelease->_cond.wait_for(lock, std::chrono::milliseconds(intervalMs), [] { return bgRelease->_stop; }))
+		{
+			lock.unlock();
+			uint64_t ageMs = _releaseAgeMs.load(std::memory_order_relaxed);
+			for (size_t i = 0; i < NPAGE_ARENAS; i++)
+			{
+				PageCache* arena = &Arenas()[i];
+				arena->_pageMtx.lock();
+				arena->ReleaseIdleSpans(ageMs, HugePageMode());
+				arena->_pageMtx.unlock();
+			}
+			lock.lock();
+		}
+	});
+	return true;
+}
+
+//ֹ̨ͣ黹߳
+void PageCache::StopBackgroundRelease()
+{
+	std::thread t;
+	{
+		std::lock_guard<std::mutex> lock(releaseMtx);
+		if (bgRelease == nullptr)
+		{
+			return;
+		}
+		bgRelease->_stop = true;
+		t.swap(bgRelease->_thread);
+	}
+	bgRelease->_cond.notify_all();
+	if (t.joinable())
+	{
+		t.join();
+	}
 }
\ No newline at end of file
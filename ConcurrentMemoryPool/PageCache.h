@@ -4,36 +4,225 @@
 #include "ObjectPool.h"
 #include "PageMap.h"
 
+//NewSpanûkҳĿspanʱѡĸspanз
+enum PagePolicy
+{
+	PAGE_BEST_FIT,       //ҳӽkspanλͼһλɨ裬Ĭϲ
+	PAGE_FIRST_FIT,      //ѡֱӴĿspanУһλɨ裬СspanҪǵ
+	PAGE_ADDRESS_ORDERED //Ͱڰַйspanѡַ͵ģҪڴաƬ
+};
 
-//ģʽ
+//page cacheֳNPAGE_ARENASarenaÿarenaԼspanspanأ
+//̵߳һõpage cacheʱתֵһarenaͬarenaͷŻ
+//arena֮乲ÿһҳ¼ĸarena
+//ϲʱֻϲͬһarenaspanͷspanʱҲҳһarena
 class PageCache
 {
 public:
-	//ṩһȫַʵ
-	static PageCache* GetInstance()
+	//ÿarenaĴspanĬ໺ֽ64MB
+	static const size_t DEFAULT_LARGE_SPAN_LIMIT = 64 * 1024 * 1024;
+	//spanĬ1ŻᱻԶ黹ϵͳ
+	static const uint64_t DEFAULT_RELEASE_AGE_MS = 1000;
+	//ÿarenaĬÿͷ64MBһõspan
+	static const size_t DEFAULT_RELEASE_TRIGGER_BYTES = 64 * 1024 * 1024;
+
+	//ṩһȫַʵ㣬صǰ߳ʹõarena
+	static PageCache* GetInstance();
+
+	//spanarenaͷspanʱҪarena
+	static PageCache* GetArena(Span* span)
 	{
-		return &_sInst;
+		size_t id = Maps()._idArenaMap.get(span->_pageId);
+		assert(id > 0 && id <= NPAGE_ARENAS);
+		return &Arenas()[id - 1];
 	}
+
 	//ȡһkҳspan
 	Span* NewSpan(size_t k);
+	//ȡһkҳʼַalignPagesҳspanalignPages2
+	Span* NewSpanAligned(size_t k, size_t alignPages);
+	//ԭذʹеspanСΪkҳҪspanarenaԭʱfalse
+	bool ResizeSpan(Span* span, size_t k);
+
+	//ȡӶspanӳ䣨̵߳ã
+	static Span* MapObjectToSpan(void* obj);
 
-	//ȡӶspanӳ
-	Span* MapObjectToSpan(void* obj);
+	//ȡҳĹϣͰ±10ʾҳcentral cacheзֵspan
+	//ͷСʱֻҪһβȥspan
+	static size_t MapObjectToSizeClass(void* obj)
+	{
+		return Maps()._idClassMap.get((PAGE_ID)obj >> PAGE_SHIFT);
+	}
+
+	//¼spanÿһҳӦĹϣͰ±꣬index0ʾ
+	static void SetSpanSizeClass(Span* span, size_t index);
 
 	//ͷſеspanصPageCacheϲڵspan
 	void ReleaseSpanToPageCache(Span* span);
 
-	std::mutex _pageMtx; //
+	//һͷŶspanspan֮_nextspanڲͬarena
+	//arenaÿarenaֻһ÷Ҫ
+	static void ReleaseSpansToPageCache(Span* spans);
+
+	//arenaѡspanĲԣлPAGE_ADDRESS_ORDERED¹spanŰַ
+	static void SetPolicy(PagePolicy policy)
+	{
+		_policy.store(policy, std::memory_order_relaxed);
+	}
+	static PagePolicy GetPolicy()
+	{
+		return _policy.load(std::memory_order_relaxed);
+	}
+
+	//ÿarenaĴspan໺ֽڣִӿõspanʼϵͳ0ʾ
+	static void SetLargeSpanLimit(size_t bytes)
+	{
+		_largeSpanLimit.store(bytes, std::memory_order_relaxed);
+	}
+
+	//arenaĴspanǰġڴеֽҪ_pageMtx
+	size_t LargeSpanBytes()
+	{
+		return _largeBytes;
+	}
+
+	//central cacheĴ仺棬ٰarenaȫеҳ黹ϵͳַ֮󻹿Ըãع黹ֽ
+	static size_t ReleaseFreeMemory();
+
+	//arenaѾ黹ϵͳԸõĿֽ
+	static size_t ReleasedBytes();
+
+	//гageMsspanŻᱻԶ黹
+	static void SetReleaseAge(uint64_t ageMs)
+	{
+		_releaseAgeMs.store(ageMs, std::memory_order_relaxed);
+	}
+
+	//ÿarenaͷŵֽۼƴﵽbytesʱͷ·˳黹һõspan0ʾر
+	static void SetReleaseTriggerBytes(size_t bytes)
+	{
+		_releaseTriggerBytes.store(bytes, std::memory_order_relaxed);
+	}
+
+	//lazyΪtrueʱMADV_FREEMADV_DONTNEED
+	static void SetReleaseLazily(bool lazy)
+	{
+		_releaseLazily.store(lazy, std::memory_order_relaxed);
+	}
+
+	//ҳģʽϵͳʱ2MB롢2MB룬ʣҳͬһҳʹã
+	//Զ黹ֻֽ̨̣߳黹ĴҳֻReleaseFreeMemoryɢҳ
+	//Ӧڴ֮ǰãCMP_HUGEPAGE=1ʱ
+	static void SetHugePageMode(bool enable)
+	{
+		_hugePageMode.store(enable, std::memory_order_relaxed);
+	}
+	static bool HugePageMode()
+	{
+		return _hugePageMode.load(std::memory_order_relaxed);
+	}
+
+	//ҳģʽǷڴmadvise(MADV_HUGEPAGE)ĬϿ
+	//ںTHPΪalwaysʱʾҲʹôҳΪmadviseʱʾ
+	static void SetHugePageHint(bool hint)
+	{
+		_hugePageHint.store(hint, std::memory_order_relaxed);
+	}
+
+	//̨̣߳ÿintervalMs黹arenaùõspanѾʱfalse
+	static bool StartBackgroundRelease(size_t intervalMs);
+	//ֹ̨ͣ黹߳
+	static void StopBackgroundRelease();
+
+	//ͳarenakҳspanĸspans[k]k<NPAGESɵ÷㣩spanĸҳ
+	//ϵͳֽһڴеֽѾ黹ֽ
+	static void GetPageStats(size_t spans[NPAGES], size_t& largeSpans, size_t& largePages,
+		size_t& mappedBytes, size_t& freeBytes, size_t& releasedBytes);
+
+	//arena뷢Ĵ֮
+	static void GetLockStats(size_t& acquires, size_t& contended);
+	static void ResetLockStats();
+
+	StatMutex _pageMtx; //arena
 private:
+	//alignPagesҳϵͳkҳЩҳarenaӳ
+	void* SystemAllocPages(size_t k, size_t alignPages);
+
+	//arena_idArenaMapеıţ±10ʾҳκarena
+	unsigned char ArenaId()
+	{
+		return (unsigned char)(this - Arenas() + 1);
+	}
+
+	//ѿspanҵӦͰУάͰķǿλͼ
+	void PushFreeSpan(Span* span);
+	//ѿspanͰժ
+	void EraseFreeSpan(Span* span);
+	//ǰҵkҳķǿͰû򷵻NPAGES
+	size_t FindSpanList(size_t k);
+	//ڴspankҳСspanû򷵻nullptr
+	Span* FindLargeSpan(size_t k);
+	//ѾժµĿspanͷгkҳȥʣಿ¹һ
+	Span* CarveSpan(Span* span, size_t k);
+	//ȥspanҳӳ
+	void MapInUseSpan(Span* span);
+	//spanлֽʱӿõspanʼϵͳ
+	void TrimLargeSpans();
+	//ǰڵĿspanϲ
+	void CoalesceAndPush(Span* span);
+	//ѱarenaпгageMs롢ûй黹span黹ϵͳع黹ֽ
+	//wholeHugePagesΪtrueʱֻ黹spanǵ2MBҳ
+	size_t ReleaseIdleSpans(uint64_t ageMs, bool wholeHugePages);
+
 	SpanList _spanLists[NPAGES];
+	static const size_t MASK_WORDS = (NPAGES + 63) / 64;
+	uint64_t _spanMask[MASK_WORDS] = { 0 }; //iλΪ1ʾiͰǿ
+	//128ҳĿspanҳַСУʱȡһģbest fit
+	//黺ͷʱֱӸãÿζmmap/munmap
+	SpanList _largeSpans;
+	size_t _largeBytes = 0; //_largeSpansлڴеֽѾ黹Ĳ뻺
+	size_t _releasedBytes = 0; //Ѿ黹ϵͳֽ
+	size_t _freedBytes = 0; //ϴι黹֮ͷŻرarenaֽ
+	size_t _mappedBytes = 0; //arenaϵͳ롢ûлϵͳֽ
+	ObjectPool<Span> _spanPool;
+
 	//std::unordered_map<PAGE_ID, Span*> _idSpanMap;
-	TCMalloc_PageMap1<32 - PAGE_SHIFT> _idSpanMap;
+	struct PageMaps
+	{
+#if INTPTR_MAX == INT64_MAX
+		//64λûַֻ̬48λ迪Ҷ
+		TCMalloc_PageMap3<48 - PAGE_SHIFT> _idSpanMap;
+		TCMalloc_PageMap3<48 - PAGE_SHIFT, unsigned char> _idClassMap; //ҳ->ϣͰ±+1
+		TCMalloc_PageMap3<48 - PAGE_SHIFT, unsigned char> _idArenaMap; //ҳ->arena±+1
+#else
+		TCMalloc_PageMap1<32 - PAGE_SHIFT> _idSpanMap;
+		TCMalloc_PageMap1<32 - PAGE_SHIFT, unsigned char> _idClassMap; //ҳ->ϣͰ±+1
+		TCMalloc_PageMap1<32 - PAGE_SHIFT, unsigned char> _idArenaMap; //ҳ->arena±+1
+#endif
+	};
+	//arenaڵһʹʱŹ죨ڵľ̬󣩣滻ϵͳmallocʱ
+	//ľ̬ʼڱȫֶĹڴ档
+	//ǶûʱatexitעᣬҲͲڹٴεmalloc
+	static PageMaps& Maps()
+	{
+		static PageMaps maps;
+		return maps;
+	}
+	static PageCache* Arenas()
+	{
+		static PageCache arenas[NPAGE_ARENAS];
+		return arenas;
+	}
+	static std::mutex _mapMtx; //½ʱ
+	static inline std::atomic<PagePolicy> _policy{ PAGE_BEST_FIT };
+	static inline std::atomic<size_t> _largeSpanLimit{ DEFAULT_LARGE_SPAN_LIMIT };
+	static inline std::atomic<uint64_t> _releaseAgeMs{ DEFAULT_RELEASE_AGE_MS };
+	static inline std::atomic<size_t> _releaseTriggerBytes{ DEFAULT_RELEASE_TRIGGER_BYTES };
+	static inline std::atomic<bool> _releaseLazily{ false };
+	static inline std::atomic<bool> _hugePageMode{ false };
+	static inline std::atomic<bool> _hugePageHint{ true };
 
-	ObjectPool<Span> _spanPool;
-	
 	PageCache() //캯˽
 	{}
 	PageCache(const PageCache&) = delete; //
-
-	static PageCache _sInst;
-};
+};
\ No newline at end of file
@@ -2,34 +2,48 @@
 
 #include "Common.h"
 
+//并发约定：Ensure会开辟结点，只在持有PageCache::_mapMtx时调用；
+//set只写已开辟好的叶子，各arena在自己的锁下写各自的页号，互不重叠；
+//get不加锁，可以和set并发执行。叶子/结点指针和span指针都用release写、acquire读，
+//读到一个非空的指针时，写者在发布之前对它做的初始化一定可见
+
 //单层基数树
-template <int BITS>
+//T为每一页映射的值类型，默认存span指针，也可以存size class这类更紧凑的值
+template <int BITS, class T = void*>
 class TCMalloc_PageMap1
 {
 public:
 	typedef uintptr_t Number;
 	explicit TCMalloc_PageMap1()
 	{
-		size_t size = sizeof(void*) << BITS; //需要开辟数组的大小
+		size_t size = sizeof(std::atomic<T>) << BITS; //需要开辟数组的大小
 		size_t alignSize = SizeClass::_RoundUp(size, 1 << PAGE_SHIFT); //按页对齐后的大小
-		array_ = (void**)SystemAlloc(alignSize >> PAGE_SHIFT); //向堆申请空间
-		memset(array_, 0, size); //对申请到的内存进行清理
+		array_ = (std::atomic<T>*)SystemAlloc(alignSize >> PAGE_SHIFT); //向堆申请空间
+		for (size_t i = 0; i < (size_t)LENGTH; i++) //对申请到的内存进行初始化
+		{
+			new(&array_[i]) std::atomic<T>(T());
+		}
 	}
-	void* get(Number k) const
+	T get(Number k) const
 	{
 		if ((k >> BITS) > 0) //k的范围不在[0, 2^BITS-1]
 		{
-			return NULL;
+			return T();
 		}
-		return array_[k]; //返回该页号对应的span
+		return array_[k].load(std::memory_order_acquire); //返回该页号对应的span
 	}
-	void set(Number k, void* v)
+	void set(Number k, T v)
 	{
 		assert((k >> BITS) == 0); //k的范围必须在[0, 2^BITS-1]
-		array_[k] = v; //建立映射
+		array_[k].store(v, std::memory_order_release); //建立映射
+	}
+	//数组在构造时已经全部开辟好了
+	bool Ensure(Number start, size_t n)
+	{
+		return (start >> BITS) == 0 && ((start + n - 1) >> BITS) == 0;
 	}
 private:
-	void** array_; //存储映射关系的数组
+	std::atomic<T>* array_; //存储映射关系的数组
 	static const int LENGTH = 1 << BITS; //页的数目
 };
 
@@ -99,7 +113,9 @@ public:
 };
 
 //三层基数树
-template <int BITS>
+//第一层直接内嵌在对象中，未开辟的位置统一指向一个全零的哨兵结点/哨兵叶子，
+//这样get时不需要逐层判空，只需要三次连续的取值
+template <int BITS, class T = void*>
 class TCMalloc_PageMap3
 {
 private:
@@ -107,13 +123,13 @@ private:
 	static const int INTERIOR_LENGTH = 1 << INTERIOR_BITS; //第一、二层存储元素的个数
 	static const int LEAF_BITS = BITS - 2 * INTERIOR_BITS; //第三层对应页号的比特位个数
 	static const int LEAF_LENGTH = 1 << LEAF_BITS;         //第三层存储元素的个数
-	struct Node
+	struct Leaf
 	{
-		Node* ptrs[INTERIOR_LENGTH];
+		std::atomic<T> values[LEAF_LENGTH];
 	};
-	struct Leaf
+	struct Node
 	{
-		void* values[LEAF_LENGTH];
+		std::atomic<Leaf*> ptrs[INTERIOR_LENGTH];
 	};
 	Node* NewNode()
 	{
@@ -121,37 +137,69 @@ private:
 		Node* result = nodePool.New();
 		if (result != NULL)
 		{
-			memset(result, 0, sizeof(*result));
+			for (int i = 0; i < INTERIOR_LENGTH; i++)
+			{
+				result->ptrs[i].store(&emptyLeaf_, std::memory_order_relaxed); //新结点的孩子都先指向哨兵叶子
+			}
 		}
 		return result;
 	}
-	Node* root_;
+	Leaf* NewLeaf()
+	{
+		static ObjectPool<Leaf> leafPool;
+		Leaf* result = leafPool.New();
+		if (result != NULL)
+		{
+			for (int i = 0; i < LEAF_LENGTH; i++)
+			{
+				result->values[i].store(T(), std::memory_order_relaxed);
+			}
+		}
+		return result;
+	}
+	std::atomic<Node*> root_[INTERIOR_LENGTH]; //第一层数组
+	Node emptyNode_;              //哨兵结点，孩子全部指向emptyLeaf_
+	Leaf emptyLeaf_;              //哨兵叶子，值全部为T()
 public:
 	typedef uintptr_t Number;
 	explicit TCMalloc_PageMap3()
 	{
-		root_ = NewNode();
+		for (int i = 0; i < LEAF_LENGTH; i++)
+		{
+			emptyLeaf_.values[i].store(T(), std::memory_order_relaxed);
+		}
+		for (int i = 0; i < INTERIOR_LENGTH; i++)
+		{
+			emptyNode_.ptrs[i].store(&emptyLeaf_, std::memory_order_relaxed);
+			root_[i].store(&emptyNode_, std::memory_order_relaxed);
+		}
 	}
-	void* get(Number k) const
+	T get(Number k) const
 	{
+		if ((k >> BITS) > 0) //页号超出范围
+		{
+			return T();
+		}
 		const Number i1 = k >> (LEAF_BITS + INTERIOR_BITS);         //第一层对应的下标
 		const Number i2 = (k >> LEAF_BITS) & (INTERIOR_LENGTH - 1); //第二层对应的下标
 		const Number i3 = k & (LEAF_LENGTH - 1);                    //第三层对应的下标
-		//页号超出范围，或映射该页号的空间未开辟
-		if ((k >> BITS) > 0 || root_->ptrs[i1] == NULL || root_->ptrs[i1]->ptrs[i2] == NULL)
-		{
-			return NULL;
-		}
-		return reinterpret_cast<Leaf*>(root_->ptrs[i1]->ptrs[i2])->values[i3]; //返回该页号对应span的指针
+		//未开辟的位置会落到哨兵叶子上，得到的就是T()
+		//x86下acquire读就是普通的mov，不会比原来多出指令
+		Node* node = root_[i1].load(std::memory_order_acquire);
+		Leaf* leaf = node->ptrs[i2].load(std::memory_order_acquire);
+		return leaf->values[i3].load(std::memory_order_acquire); //返回该页号对应span的指针
 	}
-	void set(Number k, void* v)
+	//调用前必须先通过Ensure开辟好k所在的叶子
+	void set(Number k, T v)
 	{
 		assert(k >> BITS == 0);
 		const Number i1 = k >> (LEAF_BITS + INTERIOR_BITS);         //第一层对应的下标
 		const Number i2 = (k >> LEAF_BITS) & (INTERIOR_LENGTH - 1); //第二层对应的下标
 		const Number i3 = k & (LEAF_LENGTH - 1);                    //第三层对应的下标
-		Ensure(k, 1); //确保映射第k页页号的空间是开辟好了的
-		reinterpret_cast<Leaf*>(root_->ptrs[i1]->ptrs[i2])->values[i3] = v; //建立该页号与对应span的映射
+		//结点可能是别的arena开辟的，用acquire读保证看到它的初始化
+		Leaf* leaf = root_[i1].load(std::memory_order_acquire)->ptrs[i2].load(std::memory_order_acquire);
+		assert(leaf != &emptyLeaf_); //不能往哨兵叶子里写
+		leaf->values[i3].store(v, std::memory_order_release); //建立该页号与对应span的映射
 	}
 	//确保映射[start,start+n-1]页号的空间是开辟好了的
 	bool Ensure(Number start, size_t n)
@@ -162,21 +210,20 @@ public:
 			const Number i2 = (key >> LEAF_BITS) & (INTERIOR_LENGTH - 1); //第二层对应的下标
 			if (i1 >= INTERIOR_LENGTH || i2 >= INTERIOR_LENGTH) //下标值超出范围
 				return false;
-			if (root_->ptrs[i1] == NULL) //第一层i1下标指向的空间未开辟
+			Node* node = root_[i1].load(std::memory_order_relaxed);
+			if (node == &emptyNode_) //第一层i1下标指向的空间未开辟
 			{
-				//开辟对应空间
-				Node* n = NewNode();
-				if (n == NULL) return false;
-				root_->ptrs[i1] = n;
+				//开辟对应空间，初始化完成后再发布给读者
+				node = NewNode();
+				if (node == NULL) return false;
+				root_[i1].store(node, std::memory_order_release);
 			}
-			if (root_->ptrs[i1]->ptrs[i2] == NULL) //第二层i2下标指向的空间未开辟
+			if (node->ptrs[i2].load(std::memory_order_relaxed) == &emptyLeaf_) //第二层i2下标指向的空间未开辟
 			{
-				//开辟对应空间
-				static ObjectPool<Leaf> leafPool;
-				Leaf* leaf = leafPool.New();
+				//开辟对应空间，初始化完成后再发布给读者
+				Leaf* leaf = NewLeaf();
 				if (leaf == NULL) return false;
-				memset(leaf, 0, sizeof(*leaf));
-				root_->ptrs[i1]->ptrs[i2] = reinterpret_cast<Node*>(leaf);
+				node->ptrs[i2].store(leaf, std::memory_order_release);
 			}
 			key = ((key >> LEAF_BITS) + 1) << LEAF_BITS; //继续后续检查
 		}
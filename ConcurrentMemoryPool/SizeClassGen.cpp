@@ -0,0 +1,237 @@
+//߹ߣʵʵСֲsize class
+//
+//÷SizeClassGen [-w ˷Ѱٷֱ] [-n Ͱ] histogram.txt > SizeClassTable.h
+//Ȼ -DCMP_SIZE_CLASS_TABLE="\"/path/SizeClassTable.h\""CMake -DCMP_SIZE_CLASS_TABLE=/path/SizeClassTable.h±
+//
+//ֱͼÿǡС Ҳbpftraceġ@[С]: ʽ#ͷעͣ磺
+//bpftrace -e 'uprobe:/lib/x86_64-linux-gnu/libc.so.6:malloc /pid == 1234/ { @[arg0] = count(); }' > histogram.txt
+//
+//ɷ
+//1Ȱ˷ѱɻı֤СֱͼûгֵģƬ
+//   ֻ8ֽ/128ֽڵĲȷŲʱСĶ󣩲Żᳬ
+//2ʣµͰðȨ˷ֽ½ĶСֱûͰ
+//ÿСCheckClassSizesҪ󣨲ȡ2ݶ룩µĶСƻе
+#include "Common.h"
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+
+//(prev, size]а2ݣһҳǸΪСʱCheckClassSizesĶҪ
+static size_t MostAligned(size_t prev, size_t size)
+{
+	size_t align = (size_t)1 << PAGE_SHIFT;
+	while (size / align == prev / align)
+	{
+		align >>= 1;
+	}
+	return size / align * align;
+}
+
+//sizeΪprevĶСǷCheckClassSizesҪ
+static bool ValidAfter(size_t prev, size_t size)
+{
+	return MostAligned(prev, size) == size && size % (size <= 1024 ? 8 : 128) == 0;
+}
+
+//ͳƵֱͼ_count[s]_bytes[s]ǴСsֽ֮
+struct Histogram
+{
+	std::vector<double> _count;
+	std::vector<double> _bytes;
+
+	//СΪsizeһСΪprevͰУȨ˷ֽ
+	double Waste(size_t prev, size_t size) const
+	{
+		return size * (_count[size] - _count[prev]) - (_bytes[size] - _bytes[prev]);
+	}
+
+	double Waste(const std::set<size_t>& sizes) const
+	{
+		double waste = 0;
+		size_t prev = 0;
+		for (size_t size : sizes)
+		{
+			waste += Waste(prev, size);
+			prev = size;
+		}
+		return waste;
+	}
+};
+
+static bool ReadHistogram(const char* path, Histogram& hist, double& largeCount)
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+	{
+		return false;
+	}
+	std::vector<double> count(MAX_BYTES + 1, 0);
+	char line[256];
+	while (fgets(line, sizeof(line), file) != nullptr)
+	{
+		unsigned long long size = 0;
+		double n = 0;
+		if (sscanf(line, " @[%llu]: %lf", &size, &n) != 2 && sscanf(line, " %llu %lf", &size, &n) != 2)
+		{
+			continue; //ע͡кbpftrace
+		}
+		if (size > MAX_BYTES)
+		{
+			largeCount += n; //ֱӰҳ䣬size class
+			continue;
+		}
+		count[size == 0 ? 1 : size] += n; //0ֽڰ1ֽڴ
+	}
+	fclose(file);
+
+	hist._count.assign(MAX_BYTES + 1, 0);
+	hist._bytes.assign(MAX_BYTES + 1, 0);
+	for (size_t s = 1; s <= MAX_BYTES; s++)
+	{
+		hist._count[s] = hist._count[s - 1] + count[s];
+		hist._bytes[s] = hist._bytes[s - 1] + count[s] * s;
+	}
+	return true;
+}
+
+//һÿͰ˷maxWasteıСcһprev(c - prev) / c <= maxWaste
+static std::set<size_t> BaseClasses(double maxWaste)
+{
+	std::set<size_t> sizes;
+	size_t prev = 0;
+	while (prev < MAX_BYTES)
+	{
+		size_t size = (size_t)(prev / (1 - maxWaste));
+		if (size > MAX_BYTES)
+		{
+			size = MAX_BYTES;
+		}
+		size = size / (size <= 1024 ? 8 : 128) * (size <= 1024 ? 8 : 128);
+		if (size <= prev) //ȷŲ£ȡһõĴС
+		{
+			size = prev < 1024 ? prev + 8 : prev + 128;
+		}
+		size = MostAligned(prev, size);
+		sizes.insert(size);
+		prev = size;
+	}
+	return sizes;
+}
+
+//ڶüȨ˷½ĶС
+static void AddHotClasses(const Histogram& hist, std::set<size_t>& sizes, size_t maxClasses)
+{
+	while (sizes.size() < maxClasses)
+	{
+		size_t best = 0;
+		double bestGain = 0;
+		for (size_t size = 8; size < MAX_BYTES; size += (size < 1024 ? 8 : 128))
+		{
+			auto next = sizes.lower_bound(size);
+			if (*next == size)
+			{
+				continue;
+			}
+			size_t prev = next == sizes.begin() ? 0 : *std::prev(next);
+			if (!ValidAfter(prev, size))
+			{
+				continue;
+			}
+			//(prev, size]е*nextͰŲµͰÿ˷*next - sizeֽ
+			double gain = (hist._count[size] - hist._count[prev]) * (*next - size);
+			if (gain > bestGain)
+			{
+				best = size;
+				bestGain = gain;
+			}
+		}
+		if (best == 0)
+		{
+			break;
+		}
+		sizes.insert(best);
+	}
+}
+
+static void Usage()
+{
+	fprintf(stderr, "usage: SizeClassGen [-w max_waste_percent] [-n max_classes] histogram.txt > SizeClassTable.h\n");
+	exit(2);
+}
+
+int main(int argc, char* argv[])
+{
+	double maxWaste = 0.125;
+	size_t maxClasses = NFREELISTS;
+	const char* path = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "-w" && i + 1 < argc)
+		{
+			maxWaste = atof(argv[++i]) / 100;
+		}
+		else if (arg == "-n" && i + 1 < argc)
+		{
+			maxClasses = (size_t)atoi(argv[++i]);
+		}
+		else if (path == nullptr && arg[0] != '-')
+		{
+			path = argv[i];
+		}
+		else
+		{
+			Usage();
+		}
+	}
+	if (path == nullptr || maxWaste <= 0 || maxWaste >= 1 || maxClasses > 254)
+	{
+		Usage();
+	}
+
+	Histogram hist;
+	double largeCount = 0;
+	if (!ReadHistogram(path, hist, largeCount))
+	{
+		fprintf(stderr, "cannot open %s\n", path);
+		return 1;
+	}
+
+	std::set<size_t> sizes = BaseClasses(maxWaste);
+	if (sizes.size() > maxClasses)
+	{
+		fprintf(stderr, "%zu classes are needed to keep waste under %.1f%%, raise -n or -w\n",
+			sizes.size(), maxWaste * 100);
+		return 1;
+	}
+	AddHotClasses(hist, sizes, maxClasses);
+
+	std::vector<uint32_t> table(sizes.begin(), sizes.end());
+	if (!CheckClassSizes(table.data(), table.size()))
+	{
+		fprintf(stderr, "internal error: generated table is invalid\n");
+		return 1;
+	}
+
+	//ĬϵıȽϰȨƬ
+	std::set<size_t> defaults(CLASS_SIZE_TABLE.begin(), CLASS_SIZE_TABLE.end());
+	double total = hist._bytes[MAX_BYTES];
+	double count = hist._count[MAX_BYTES];
+	double oldWaste = hist.Waste(defaults);
+	double newWaste = hist.Waste(sizes);
+	fprintf(stderr, "%.0f small allocations (%.0f large ignored), %zu classes\n", count, largeCount, table.size());
+	fprintf(stderr, "weighted waste: current table %.2f%%, generated table %.2f%%\n",
+		total > 0 ? oldWaste * 100 / (total + oldWaste) : 0, total > 0 ? newWaste * 100 / (total + newWaste) : 0);
+
+	printf("//SizeClassGenɣ%s˷%.1f%%%zuͰ\n", path, maxWaste * 100, table.size());
+	printf("//ʱCMP_SIZE_CLASS_TABLEΪļ·滻Common.hĬϵsize class\n");
+	printf("#pragma once\n\n");
+	printf("inline constexpr std::array<uint32_t, %zu> CLASS_SIZE_TABLE = { {", table.size());
+	for (size_t i = 0; i < table.size(); i++)
+	{
+		printf("%s%u%s", i % 8 == 0 ? "\n\t" : " ", table[i], i + 1 < table.size() ? "," : "");
+	}
+	printf("\n} };\n");
+	return 0;
+}
@@ -1,19 +1,401 @@
 #include "ThreadCache.h"
 #include "CentralCache.h"
+#include "PageCache.h"
+#include "HeapProfiler.h"
+
+#ifndef _WIN32
+	#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+_declspec(thread) ThreadCache* pTLSThreadCache = nullptr;
+#else
+__thread ThreadCache* pTLSThreadCache __attribute__((tls_model("initial-exec"))) = nullptr;
+#endif
+
+static std::mutex tcMtx;
+static ObjectPool<ThreadCache> tcPool;
+//߳ͷŶУ߳̿˳̵߳Ķָ룬ԶдӲͷţ
+//رպڿϸµ̸߳ãtcMtx
+static ObjectPool<RemoteFreeQueue> remoteQueuePool;
+static RemoteFreeQueue* idleRemoteQueues = nullptr;
+
+//CMP_REMOTE_FREE=1ʱ߳ͷģʽ
+static bool InitRemoteFree()
+{
+	const char* env = getenv("CMP_REMOTE_FREE");
+	if (env != nullptr && strcmp(env, "1") == 0)
+	{
+		ThreadCache::SetRemoteFree(true);
+		return true;
+	}
+	return false;
+}
+static bool remoteFreeEnv = InitRemoteFree();
+
+//ȫԤ㣬tcmallocthread cache balancing
+//ԤлûзָκThreadCacheĲּunclaimedBytes̺߳ܶʱΪ
+//æµ̻߳泬ʱȡⲿ֣첻ThreadCacheŲã
+//̵߳ԤתƵæµ߳ϣܻ߳
+static std::mutex budgetMtx;
+static long long unclaimedBytes = ThreadCache::DEFAULT_OVERALL_BYTES;
+static ThreadCache* cacheListHead = nullptr; //мԤThreadCache
+static ThreadCache* nextVictim = nullptr;    //һŲԤThreadCache
+static size_t cacheCount = 0;                //ԤThreadCache
+static FreeListCounters exitedCounters[NFREELISTS]; //Ѿ˳ԤThreadCacheĳȵڼ
+
+//߳˳ʱգĶ󻹸central cacheThreadCache󻹸tcPool
+//߳ЩԶй©ڵspan_useCountҲԶ0޷page cacheϲ
+static void ThreadCacheExit(void* arg)
+{
+	ThreadCache* tc = (ThreadCache*)arg;
+	tc->CloseRemoteFrees();
+	tc->ReleaseAll();
+	ThreadCache::UnregisterCache(tc);
+	if (pTLSThreadCache == tc)
+	{
+		pTLSThreadCache = nullptr;
+	}
+	tcMtx.lock();
+	tcPool.Delete(tc);
+	tcMtx.unlock();
+}
+
+#ifdef _WIN32
+//Windows½thread_local
+struct ThreadCacheExitGuard
+{
+	ThreadCache* _tc = nullptr;
+	~ThreadCacheExitGuard()
+	{
+		if (_tc != nullptr)
+		{
+			ThreadCacheExit(_tc);
+		}
+	}
+};
+static thread_local ThreadCacheExitGuard tcExitGuard;
+#else
+//linuxʹpthread keyC++ʱTLSЧʱ
+static pthread_key_t tcExitKey;
+#endif
+
+//Ϊǰ̴߳ThreadCacheע߳˳ʱĻ
+ThreadCache* ThreadCache::CreateForCurrentThread()
+{
+	tcMtx.lock();
+	//pTLSThreadCache = new ThreadCache;
+	ThreadCache* tc = tcPool.New();
+	if (idleRemoteQueues != nullptr)
+	{
+		tc->_remote = idleRemoteQueues;
+		idleRemoteQueues = idleRemoteQueues->_nextIdle;
+		tc->_remote->Open();
+	}
+	else
+	{
+		tc->_remote = remoteQueuePool.New();
+	}
+	tcMtx.unlock();
+	RegisterCache(tc);
+
+#ifdef _WIN32
+	tcExitGuard._tc = tc;
+#else
+	static bool keyCreated = (pthread_key_create(&tcExitKey, ThreadCacheExit) == 0);
+	if (keyCreated)
+	{
+		pthread_setspecific(tcExitKey, tc);
+	}
+#endif
+	return tc;
+}
+
+//ȫԤ
+void ThreadCache::RegisterCache(ThreadCache* tc)
+{
+	std::lock_guard<std::mutex> lock(budgetMtx);
+	unclaimedBytes -= (long long)tc->MaxBytes();
+	tc->_prev = nullptr;
+	tc->_next = cacheListHead;
+	if (cacheListHead != nullptr)
+	{
+		cacheListHead->_prev = tc;
+	}
+	cacheListHead = tc;
+	cacheCount++;
+}
+
+//˳ȫԤ㣬Ԥ㻹unclaimedBytes
+void ThreadCache::UnregisterCache(ThreadCache* tc)
+{
+	std::lock_guard<std::mutex> lock(budgetMtx);
+	unclaimedBytes += (long long)tc->MaxBytes();
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		tc->_freeLists[i].GetCounters(exitedCounters[i]);
+	}
+	if (nextVictim == tc)
+	{
+		nextVictim = tc->_next;
+	}
+	if (tc->_prev != nullptr)
+	{
+		tc->_prev->_next = tc->_next;
+	}
+	else
+	{
+		cacheListHead = tc->_next;
+	}
+	if (tc->_next != nullptr)
+	{
+		tc->_next->_prev = tc->_prev;
+	}
+	tc->_next = tc->_prev = nullptr;
+	cacheCount--;
+}
+
+//ThreadCacheֽԤ
+void ThreadCache::SetOverallBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(budgetMtx);
+	//ѾֳȥԤ㱣ֲ䣬ֻûֳȥĲ
+	long long claimed = 0;
+	for (ThreadCache* tc = cacheListHead; tc != nullptr; tc = tc->_next)
+	{
+		claimed += (long long)tc->MaxBytes();
+	}
+	unclaimedBytes = (long long)bytes - claimed;
+}
+
+//ThreadCacheper-CPU棩ÿϣͰеĶۼӵobjsУThreadCacheĸ
+//̵߳ȡģõǽƵĿ
+size_t ThreadCache::GetCachedObjects(size_t objs[NFREELISTS])
+{
+	std::lock_guard<std::mutex> lock(budgetMtx);
+	for (ThreadCache* tc = cacheListHead; tc != nullptr; tc = tc->_next)
+	{
+		for (size_t i = 0; i < NFREELISTS; i++)
+		{
+			objs[i] += tc->_freeLists[i].Size();
+		}
+	}
+	return cacheCount;
+}
+
+//ThreadCacheѾ˳̣߳ÿϣͰĳȵڼۼӵcounters
+void ThreadCache::GetListCounters(FreeListCounters counters[NFREELISTS])
+{
+	std::lock_guard<std::mutex> lock(budgetMtx);
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		counters[i]._misses += exitedCounters[i]._misses;
+		counters[i]._overflows += exitedCounters[i]._overflows;
+		counters[i]._shrinks += exitedCounters[i]._shrinks;
+		counters[i]._idleReleased += exitedCounters[i]._idleReleased;
+	}
+	for (ThreadCache* tc = cacheListHead; tc != nullptr; tc = tc->_next)
+	{
+		for (size_t i = 0; i < NFREELISTS; i++)
+		{
+			tc->_freeLists[i].GetCounters(counters[i]);
+		}
+	}
+}
+
+//ȫԤȡThreadCacheŲSTEAL_BYTESԤ
+bool ThreadCache::IncreaseCacheLimit()
+{
+	std::lock_guard<std::mutex> lock(budgetMtx);
+	//1ȫԤ㻹ʣֱ࣬ȡ
+	if (unclaimedBytes >= (long long)STEAL_BYTES)
+	{
+		unclaimedBytes -= STEAL_BYTES;
+		_maxBytes.fetch_add(STEAL_BYTES, std::memory_order_relaxed);
+		return true;
+	}
+	//2ThreadCacheŲãתһȦ
+	for (size_t i = 0; i < cacheCount; i++)
+	{
+		if (nextVictim == nullptr)
+		{
+			nextVictim = cacheListHead;
+		}
+		ThreadCache* victim = nextVictim;
+		nextVictim = victim->_next;
+		if (victim != this && victim->MaxBytes() >= MIN_CACHE_BYTES + STEAL_BYTES)
+		{
+			victim->_maxBytes.fetch_sub(STEAL_BYTES, std::memory_order_relaxed);
+			_maxBytes.fetch_add(STEAL_BYTES, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+//泬ޣȳԼԤ㣬ٰļĻ
+void ThreadCache::Scavenge()
+{
+	if (IncreaseCacheLimit() && _size <= MaxBytes())
+	{
+		return;
+	}
+	//ÿֽһȥֱ޵3/4£
+	//һһͷֳ
+	size_t target = MaxBytes() / 4 * 3;
+	while (_size > target)
+	{
+		size_t maxIndex = 0;
+		size_t maxBytes = 0;
+		for (size_t i = 0; i < NFREELISTS; i++)
+		{
+			size_t bytes = _freeLists[i].Size() * SizeClass::ClassSize(i);
+			if (bytes > maxBytes)
+			{
+				maxIndex = i;
+				maxBytes = bytes;
+			}
+		}
+		if (maxBytes == 0)
+		{
+			break;
+		}
+		FreeList& list = _freeLists[maxIndex];
+		size_t n = (list.Size() + 1) / 2;
+		void* start = nullptr;
+		void* end = nullptr;
+		list.PopRange(start, end, n);
+		_size -= n * SizeClass::ClassSize(maxIndex);
+		CentralCache::GetInstance()->InsertRange(start, end, n, SizeClass::ClassSize(maxIndex));
+	}
+}
+
+//һβÿMAX_IDLE_EVENTSһοм
+//·ĴʱУҪʱӣͷŵĿ·Ҳûж⿪
+void ThreadCache::CountSlowEvent()
+{
+	if (++_slowEvents >= MAX_IDLE_EVENTS)
+	{
+		_slowEvents = 0;
+		ShrinkIdleLists();
+	}
+}
+
+//м飺һμһֱûõĶһĻ棬Щ޼루һ
+//һͻͷźµĳ֮ÿμ鶼룬һֱռڴ
+void ThreadCache::ShrinkIdleLists()
+{
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		FreeList& list = _freeLists[i];
+		size_t n = (list.LowWater() + 1) / 2;
+		if (n != 0)
+		{
+			size_t size = SizeClass::ClassSize(i);
+			void* start = nullptr;
+			void* end = nullptr;
+			list.PopRange(start, end, n);
+			_size -= n * size;
+			CentralCache::GetInstance()->InsertRange(start, end, n, size);
+			//ֻһֻͷŲҲûõĶ
+			//¼ʱȥС
+			size_t batchLimit = SizeClass::NumMoveSize(size);
+			if (list.MaxSize() > batchLimit)
+			{
+				list.MaxSize() = max(list.MaxSize() / 2, batchLimit);
+				list.AddShrink();
+			}
+			list.AddIdleReleased(n);
+		}
+		list.ResetLowWater();
+	}
+}
+
+//еĶȫĻ
+//߳˳ʱãЩ󲻻ܿ챻õֱӻspan仺棬spanлصpage cache
+void ThreadCache::ReleaseAll()
+{
+	for (size_t i = 0; i < NFREELISTS; i++)
+	{
+		FreeList& list = _freeLists[i];
+		if (!list.Empty())
+		{
+			void* start = nullptr;
+			void* end = nullptr;
+			list.PopRange(start, end, list.Size());
+			CentralCache::GetInstance()->ReleaseListToSpans(start, SizeClass::ClassSize(i));
+		}
+	}
+	_size = 0;
+}
+
+//߳ͷģʽ£ptr߳ʱѹ˵ĶУfalseʾӦɱ߳ͷ
+bool ThreadCache::FreeToOwner(void* ptr)
+{
+	Span* span = PageCache::GetInstance()->MapObjectToSpan(ptr);
+	RemoteFreeQueue* owner = span->_owner.load(std::memory_order_acquire);
+	//Ѿ˳ʱǹرյģPushʧܣɱ߳ͷ
+	return owner != nullptr && owner != _remote && owner->Push(ptr);
+}
+
+//̻߳һҳӳҵԵĹϣͰͱ߳ͷŵĶһ
+void ThreadCache::DeallocateRemoteList(void* obj)
+{
+	while (obj != nullptr)
+	{
+		void* next = NextObj(obj);
+		size_t index = PageCache::GetInstance()->MapObjectToSizeClass(obj);
+		assert(index != 0);
+		Deallocate(obj, SizeClass::ClassSize(index - 1));
+		obj = next;
+	}
+}
+
+//ȡ̻߳ĶŽǷȡ
+bool ThreadCache::DrainRemoteFrees()
+{
+	void* obj = _remote != nullptr ? _remote->PopAll() : nullptr;
+	if (obj == nullptr)
+	{
+		return false;
+	}
+	DeallocateRemoteList(obj);
+	return true;
+}
+
+//߳˳ʱرտ߳ͷŶУȡʣµĶ󣬶Ժ̸߳
+void ThreadCache::CloseRemoteFrees()
+{
+	if (_remote == nullptr)
+	{
+		return;
+	}
+	DeallocateRemoteList(_remote->Close());
+	tcMtx.lock();
+	_remote->_nextIdle = idleRemoteQueues;
+	idleRemoteQueues = _remote;
+	tcMtx.unlock();
+	_remote = nullptr;
+}
 
 //ڴ
 void* ThreadCache::Allocate(size_t size)
 {
 	assert(size <= MAX_BYTES); //thread cacheֻСڵMAX_BYTESڴ
-	size_t alignSize = SizeClass::RoundUp(size);
-	size_t index = SizeClass::Index(size);
+	if (ShouldSample(size)) //̵߳Ĳ꣬뵥ҳ䲢¼ջ
+	{
+		return HeapProfiler::SampleAllocate(size);
+	}
+	const SizeClassInfo& cls = SizeClass::Lookup(size); //һβõϣͰ±ͶĴС
+	size_t index = cls._index;
 	if (!_freeLists[index].Empty())
 	{
+		_size -= cls._size;
 		return _freeLists[index].Pop();
 	}
 	else
 	{
-		return FetchFromCentralCache(index, alignSize);
+		return FetchFromCentralCache(index, cls._size);
 	}
 }
 
@@ -24,14 +406,21 @@ void ThreadCache::Deallocate(void* ptr, size_t size)
 	assert(size <= MAX_BYTES);
 
 	//ҳӦͰ
-	size_t index = SizeClass::Index(size);
+	const SizeClassInfo& cls = SizeClass::Lookup(size);
+	size_t index = cls._index;
 	_freeLists[index].Push(ptr);
+	_size += cls._size;
 
 	//ȴһĶʱͿʼһlistcentral cache
 	if (_freeLists[index].Size() >= _freeLists[index].MaxSize())
 	{
 		ListTooLong(_freeLists[index], size);
 	}
+	//ThreadCacheֽԤ
+	if (_size > MaxBytes())
+	{
+		Scavenge();
+	}
 }
 //1 2 3 4 5->5
 //
@@ -39,17 +428,35 @@ void ThreadCache::Deallocate(void* ptr, size_t size)
 //Ļȡ
 void* ThreadCache::FetchFromCentralCache(size_t index, size_t size)
 {
+	HeapProfiler::CheckSampling();
+	//ȡ̻߳Ķ󣬹þͲcentral cache
+	if (DrainRemoteFrees() && !_freeLists[index].Empty())
+	{
+		_size -= size;
+		return _freeLists[index].Pop();
+	}
 	//ʼ㷨
 	//1ʼһcentral cacheһҪ̫࣬ΪҪ̫˿ò
-	//2㲻sizeСڴôbatchNumͻ᲻ֱ
-	size_t batchNum = min(_freeLists[index].MaxSize(), SizeClass::NumMoveSize(size));
-	if (batchNum == _freeLists[index].MaxSize())
+	//2㲻sizeСڴôbatchNumͻֱᷭһ
+	//3֮˵ã޼ͷŻĶܶһЩ
+	FreeList& list = _freeLists[index];
+	size_t batchLimit = SizeClass::NumMoveSize(size);
+	size_t batchNum = min(list.MaxSize(), batchLimit);
+	list.Streak() = list.Streak() > 0 ? list.Streak() + 1 : 1;
+	if (list.MaxSize() < batchLimit)
 	{
-		_freeLists[index].MaxSize() += 1;
+		list.MaxSize() = min(list.MaxSize() * 2, batchLimit);
 	}
+	else if (list.Streak() >= 2)
+	{
+		list.MaxSize() = min(list.MaxSize() * 2, batchLimit * MAX_LIST_BATCHES);
+	}
+	list.AddMiss();
+	CountSlowEvent();
 	void* start = nullptr;
 	void* end = nullptr;
-	size_t actualNum = CentralCache::GetInstance()->FetchRangeObj(start, end, batchNum, size);
+	RemoteFreeQueue* owner = RemoteFreeEnabled() ? _remote : nullptr; //߳ͷģʽ¼ΪЩ
+	size_t actualNum = CentralCache::GetInstance()->FetchRangeObj(start, end, batchNum, size, owner);
 	assert(actualNum >= 1); //һ
 
 	if (actualNum == 1) //뵽ĸһֱӽһ󷵻ؼ
@@ -60,6 +467,7 @@ void* ThreadCache::FetchFromCentralCache(size_t index, size_t size)
 	else //뵽ĸǶҪʣµĶҵthread cacheжӦĹϣͰ
 	{
 		_freeLists[index].PushRange(NextObj(start), end, actualNum - 1);
+		_size += (actualNum - 1) * size;
 		return start;
 	}
 }
@@ -67,11 +475,30 @@ void* ThreadCache::FetchFromCentralCache(size_t index, size_t size)
 //ͷŶڴ浽Ļ
 void ThreadCache::ListTooLong(FreeList& list, size_t size)
 {
+	//ֻһ룬µһ뻹룬޸ػȥȡ
+	size_t n = (list.Size() + 1) / 2;
 	void* start = nullptr;
 	void* end = nullptr;
-	//listȡһĶ
-	list.PopRange(start, end, list.MaxSize());
-	
-	//ȡĶ󻹸central cacheжӦspan
-	CentralCache::GetInstance()->ReleaseListToSpans(start, size);
+	list.PopRange(start, end, n);
+	_size -= n * SizeClass::RoundUp(size);
+
+	//ȡĶ󻹸central cacheŽ仺߳
+	CentralCache::GetInstance()->InsertRange(start, end, n, size);
+
+	//ֻͷŲ̰߳޼ӵһȥҲ֮
+	//Ѿһ˵סô޼
+	size_t batchLimit = SizeClass::NumMoveSize(size);
+	list.Streak() = list.Streak() < 0 ? list.Streak() - 1 : -1;
+	if (list.MaxSize() < batchLimit)
+	{
+		list.MaxSize() += 1;
+	}
+	else if (list.Streak() <= -MAX_OVERFLOWS && list.MaxSize() > batchLimit)
+	{
+		list.MaxSize() = max(list.MaxSize() / 2, batchLimit);
+		list.Streak() = 0;
+		list.AddShrink();
+	}
+	list.AddOverflow();
+	CountSlowEvent();
 }
\ No newline at end of file
@@ -5,6 +5,21 @@
 class ThreadCache
 {
 public:
+	//ThreadCacheֽĬԤ
+	static const size_t DEFAULT_OVERALL_BYTES = 32 * 1024 * 1024;
+	//ThreadCacheСԤ㣬ҪܻС
+	static const size_t MIN_CACHE_BYTES = 2 * MAX_BYTES;
+	//ÿδȫԤThreadCacheŲõֽ
+	static const size_t STEAL_BYTES = 64 * 1024;
+
+	//޵Ӧڣtcmalloc
+	//ʱ޷ֱһʱMAX_LIST_BATCHES
+	//ʱֻһcentral cache޲һʱ1MAX_OVERFLOWSʱ루һ
+	//ÿMAX_IDLE_EVENTSβһοм飺ʱһֱûõĶһȥ޼루һ
+	static const size_t MAX_LIST_BATCHES = 8;
+	static const int MAX_OVERFLOWS = 3;
+	static const size_t MAX_IDLE_EVENTS = 512;
+
 	//ڴ
 	void* Allocate(size_t size);
 
@@ -16,9 +31,95 @@ public:
 
 	//ͷŶڴ浽Ļ
 	void ListTooLong(FreeList& list, size_t size);
+
+	//еĶȫĻ
+	void ReleaseAll();
+
+	//Ϊǰ̴߳ThreadCacheע߳˳ʱĻ
+	static ThreadCache* CreateForCurrentThread();
+
+	///˳ȫԤ㣬ֻмThreadCacheŻԤŲ
+	static void RegisterCache(ThreadCache* tc);
+	static void UnregisterCache(ThreadCache* tc);
+
+	//ThreadCacheֽԤ
+	static void SetOverallBudget(size_t bytes);
+
+	//ThreadCacheÿϣͰеĶۼӵobjsУThreadCacheĸ
+	static size_t GetCachedObjects(size_t objs[NFREELISTS]);
+
+	//ThreadCacheѾ˳̣߳ÿϣͰĳȵڼۼӵcounters
+	static void GetListCounters(FreeListCounters counters[NFREELISTS]);
+
+	//رտ߳ͷģʽmimalloc̴߳central cacheȡʱΪspanˣ
+	//߳ͷЩʱѹ˵RemoteFreeQueueһβʱȡأ
+	//ص̣߳ǶѻֻͷŲ߳central cache
+	//ÿͷСҪһҳӳ䣻CMP_REMOTE_FREE=1ʱ
+	static void SetRemoteFree(bool enable)
+	{
+		_remoteFree.store(enable, std::memory_order_relaxed);
+	}
+	static bool RemoteFreeEnabled()
+	{
+		return _remoteFree.load(std::memory_order_relaxed);
+	}
+
+	//߳ͷģʽ£ptr߳ʱѹ˵ĶУfalseʾӦɱ߳ͷ
+	bool FreeToOwner(void* ptr);
+
+	//ȡ̻߳ĶŽǷȡ
+	bool DrainRemoteFrees();
+
+	//߳˳ʱرտ߳ͷŶУȡʣµĶ󣬶Ժ̸߳
+	void CloseRemoteFrees();
+
+	//ǰֽ
+	size_t CachedBytes()
+	{
+		return _size;
+	}
+	//ǰֽ
+	size_t MaxBytes()
+	{
+		return _maxBytes.load(std::memory_order_relaxed);
+	}
 private:
+	//泬ޣȳԼԤ㣬ٰļĻ
+	void Scavenge();
+
+	//ȫԤȡThreadCacheŲSTEAL_BYTESԤ
+	bool IncreaseCacheLimit();
+
+	//һβÿMAX_IDLE_EVENTSһοм
+	void CountSlowEvent();
+
+	//м飺һμһֱûõĶһĻ棬Щ޼루һ
+	void ShrinkIdleLists();
+
+	//̻߳һҳӳҵԵĹϣͰͱ߳ͷŵĶһ
+	void DeallocateRemoteList(void* obj);
+
 	FreeList _freeLists[NFREELISTS]; //ϣͰ
+	size_t _size = 0; //жֽ
+	size_t _slowEvents = 0; //һοмĲ
+	//Ԥޣ߳ŲԤʱ޸߳һͷʱֳй黹
+	std::atomic<size_t> _maxBytes{ MIN_CACHE_BYTES };
+
+	//мԤThreadCacheɵ˫Ԥ
+	ThreadCache* _next = nullptr;
+	ThreadCache* _prev = nullptr;
+
+	//̵߳Ŀ߳ͷŶУ̵ֻ߳ThreadCacheУper-CPUû
+	RemoteFreeQueue* _remote = nullptr;
+
+	static inline std::atomic<bool> _remoteFree{ false };
 };
 
 //TLS - Thread Local Storage
-static _declspec(thread) ThreadCache* pTLSThreadCache = nullptr;
\ No newline at end of file
+//ThreadCache.cppУ֤ͬһ߳б뵥ԪпͬһThreadCache
+#ifdef _WIN32
+extern _declspec(thread) ThreadCache* pTLSThreadCache;
+#else
+//initial-execģͣʱҪ__tls_get_addrֻһfsĴȡֵ
+extern __thread ThreadCache* pTLSThreadCache __attribute__((tls_model("initial-exec")));
+#endif
\ No newline at end of file
@@ -1,17 +1,39 @@
 #include "ConcurrentAlloc.h"
+#include "CentralCache.h"
+#include "AllocStats.h"
+#include "HeapProfiler.h"
+#include "ConcurrentObjectPool.h"
+#include <chrono>
+#include <stdexcept>
+#ifndef _WIN32
+	#include <sys/resource.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+
+//assertڶNDEBUGReleaseʲô飬ԪͳһʼЧCHECK
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+			abort(); \
+		} \
+	} while (0)
 
 void Alloc1()
 {
 	for (size_t i = 0; i < 5; i++)
 	{
-		void* ptr = ConcurrentAlloc(6);
+		ConcurrentAlloc(6);
 	}
 }
 void Alloc2()
 {
 	for (size_t i = 0; i < 5; i++)
 	{
-		void* ptr = ConcurrentAlloc(7);
+		ConcurrentAlloc(7);
 	}
 }
 void TLSTest()
@@ -44,9 +66,9 @@ void TestConcurrentAlloc2()
 {
 	for (size_t i = 0; i < 1024; i++)
 	{
-		void* p1 = ConcurrentAlloc(6);
+		ConcurrentAlloc(6);
 	}
-	void* p2 = ConcurrentAlloc(6);
+	ConcurrentAlloc(6);
 }
 void MultiThreadAlloc1()
 {
@@ -123,4 +145,1063 @@ void BigAlloc()
 //	//	ConcurrentFree(e);
 //	//}
 //	return 0;
-//}
\ No newline at end of file
+//}
+
+//߳ͬʱ롢ͷŸִСĶͷ·ϵMapObjectToSpan
+//߳NewSpan/ReleaseSpanToPageCache޸Ļִ
+void MultiThreadFreeTest()
+{
+	std::vector<std::thread> vthread;
+	for (size_t k = 0; k < 4; k++)
+	{
+		vthread.emplace_back([k]() {
+			std::vector<void*> v;
+			for (size_t j = 0; j < 5; j++)
+			{
+				for (size_t i = 0; i < 2000; i++)
+				{
+					size_t size = (i * 97 + k * 13) % (64 * 1024) + 1;
+					void* ptr = ConcurrentAlloc(size);
+					memset(ptr, (int)k, size);
+					v.push_back(ptr);
+				}
+				for (auto e : v)
+				{
+					ConcurrentFree(e);
+				}
+				v.clear();
+			}
+		});
+	}
+	for (auto& t : vthread)
+	{
+		t.join();
+	}
+}
+
+//size classʹСͷ
+void SizedFreeTest()
+{
+	//ClassSizeIndex
+	for (size_t bytes = 1; bytes <= MAX_BYTES; bytes++)
+	{
+		size_t index = SizeClass::Index(bytes);
+		CHECK(SizeClass::ClassSize(index) == SizeClass::RoundUp(bytes));
+		CHECK(SizeClass::Index(SizeClass::ClassSize(index)) == index);
+		CHECK(SizeClass::NumMoveSize(SizeClass::ClassSize(index)) == ClassBatchSize(SizeClass::ClassSize(index)));
+	}
+	CHECK(SizeClass::Index(0) == 0);
+
+#ifndef CMP_SIZE_CLASS_TABLE
+	//ĬϵıԭĶһ
+	for (size_t bytes = 1; bytes <= MAX_BYTES; bytes++)
+	{
+		size_t align = bytes <= 128 ? 8 : bytes <= 1024 ? 16 : bytes <= 8 * 1024 ? 128 : bytes <= 64 * 1024 ? 1024 : 8 * 1024;
+		CHECK(SizeClass::RoundUp(bytes) == SizeClass::_RoundUp(bytes, align));
+	}
+	CHECK(NFREELISTS == 208);
+#endif
+
+	void* p1 = ConcurrentAlloc(100);
+	CHECK(PageCache::GetInstance()->MapObjectToSizeClass(p1) == SizeClass::Index(100) + 1);
+	ConcurrentFree(p1, 100);
+
+	//ڴҳκιϣͰ
+	void* p2 = ConcurrentAlloc(257 * 1024);
+	CHECK(PageCache::GetInstance()->MapObjectToSizeClass(p2) == 0);
+	ConcurrentFree(p2, 257 * 1024);
+}
+
+//per-CPUģʽrseqʱSetEnabledfalse˻̻߳
+void CpuCacheTest()
+{
+	if (!CpuCache::GetInstance()->SetEnabled(true))
+	{
+		return;
+	}
+	CHECK(CpuCache::Active());
+	MultiThreadFreeTest();
+	//per-CPUģʽ롢̻߳ģʽͷҲǿԵ
+	void* ptr = ConcurrentAlloc(16);
+	CpuCache::GetInstance()->SetEnabled(false);
+	ConcurrentFree(ptr);
+}
+
+//߳˳ĶҪȫصspanspanٻصpage cache
+void ThreadExitTest()
+{
+	void* first = nullptr;
+	std::thread t([&first]() {
+		//160KBϣͰԶûùspanĶֻ߳
+		//µһͷŵĶ߳Լ
+		first = ConcurrentAlloc(160 * 1024);
+		ConcurrentFree(first);
+		CHECK(PageCache::GetInstance()->MapObjectToSizeClass(first) != 0); //߳
+	});
+	t.join();
+	CHECK(PageCache::GetInstance()->MapObjectToSizeClass(first) == 0); //spanѾpage cache
+}
+
+//ThreadCacheֽᳬԤ
+void ThreadCacheBudgetTest()
+{
+	std::thread t([]() {
+		std::vector<void*> v;
+		for (size_t i = 0; i < 4000; i++)
+		{
+			v.push_back(ConcurrentAlloc((i * 131) % (32 * 1024) + 1));
+		}
+		for (auto e : v)
+		{
+			ConcurrentFree(e);
+		}
+		CHECK(pTLSThreadCache->CachedBytes() <= pTLSThreadCache->MaxBytes());
+		CHECK(pTLSThreadCache->MaxBytes() <= ThreadCache::DEFAULT_OVERALL_BYTES);
+	});
+	t.join();
+}
+
+//ĳϣͰThreadCacheеĳȵڼͻĶ
+static FreeListCounters ListCountersOf(size_t index)
+{
+	FreeListCounters counters[NFREELISTS];
+	ThreadCache::GetListCounters(counters);
+	return counters[index];
+}
+static size_t CachedObjectsOf(size_t index)
+{
+	size_t objs[NFREELISTS] = { 0 };
+	ThreadCache::GetCachedObjects(objs);
+	return objs[index];
+}
+
+//ȵӦڣʱ޷ʱûõĶڿмʱȥ
+void AdaptiveListTest()
+{
+	const size_t size = 48;
+	const size_t index = SizeClass::Index(size);
+	const size_t batch = SizeClass::NumMoveSize(size);
+	FreeListCounters before = ListCountersOf(index);
+	std::thread t([&]() {
+		//3޴1һǶģÿμ1ʱļʮ
+		std::vector<void*> v;
+		for (size_t i = 0; i < 3 * batch; i++)
+		{
+			v.push_back(ConcurrentAlloc(size));
+		}
+		CHECK(ListCountersOf(index)._misses - before._misses <= 24);
+		//ͷŻĶУѾһ
+		for (auto e : v)
+		{
+			ConcurrentFree(e);
+		}
+		size_t cached = CachedObjectsOf(index);
+		CHECK(ListCountersOf(index)._overflows == before._overflows);
+
+		//ֻһͰĶ󣬲ϵĿм飬sizeһֱûõٻһ
+		std::vector<void*> w;
+		for (size_t i = 0; i < (2 * ThreadCache::MAX_IDLE_EVENTS + 16) * SizeClass::NumMoveSize(8); i++)
+		{
+			w.push_back(ConcurrentAlloc(8));
+		}
+		CHECK(CachedObjectsOf(index) <= cached - 3 * batch / 2);
+		CHECK(ListCountersOf(index)._idleReleased - before._idleReleased >= 3 * batch / 2);
+		for (auto e : w)
+		{
+			ConcurrentFree(e);
+		}
+	});
+	t.join();
+	//߳˳
+	CHECK(ListCountersOf(index)._misses > before._misses);
+	CHECK(ListCountersOf(index)._shrinks > before._shrinks);
+}
+
+//߳ͷģʽ߳ͷŵĶѹ̵߳ĶУ̲߳ʱȡ
+void RemoteFreeTest()
+{
+	ThreadCache::SetRemoteFree(true);
+	const size_t n = 200;
+	std::vector<void*> v(n);
+	std::thread producer([&v]() {
+		for (auto& e : v)
+		{
+			e = ConcurrentAlloc(777);
+		}
+		std::thread consumer([&v]() {
+			for (auto e : v)
+			{
+				ConcurrentFree(e);
+			}
+			CHECK(pTLSThreadCache->CachedBytes() == 0); //ȫˣûڱ߳
+		});
+		consumer.join();
+
+		std::vector<void*> sorted(v);
+		std::sort(sorted.begin(), sorted.end());
+		std::vector<void*> again;
+		size_t reused = 0;
+		for (size_t i = 0; i < 2 * n; i++)
+		{
+			again.push_back(ConcurrentAlloc(777));
+			reused += std::binary_search(sorted.begin(), sorted.end(), again.back());
+		}
+		CHECK(reused >= n / 2);
+		for (auto e : again)
+		{
+			ConcurrentFree(e);
+		}
+	});
+	producer.join();
+
+	//˳йرգͷŵ߳Լ
+	std::thread owner([&v]() {
+		for (auto& e : v)
+		{
+			e = ConcurrentAlloc(777);
+		}
+	});
+	owner.join();
+	for (auto e : v)
+	{
+		ConcurrentFree(e);
+	}
+	ThreadCache::SetRemoteFree(false);
+}
+
+//仺롢ȡֽ֮Ųȥ
+void TransferCacheTest()
+{
+	TransferCache tc;
+	void* objs[TransferCache::MAX_BATCHES + 1];
+	for (size_t i = 0; i <= TransferCache::MAX_BATCHES; i++)
+	{
+		objs[i] = &objs[i];
+		bool ok = tc.Insert(objs[i], objs[i], i + 1, 8);
+		CHECK(ok == (i < TransferCache::MAX_BATCHES));
+	}
+	void* start = nullptr;
+	void* end = nullptr;
+	CHECK(tc.Remove(start, end) == TransferCache::MAX_BATCHES);
+	CHECK(start == objs[TransferCache::MAX_BATCHES - 1] && end == start);
+	while (tc.Remove(start, end) != 0)
+	{
+	}
+	CHECK(tc.Objects() == 0);
+
+	//󣺿յĴ仺ܷŽһֽ֮
+	size_t size = TransferCache::MAX_CACHED_BYTES / 2;
+	CHECK(tc.Insert(objs[0], objs[0], 4, size));
+	CHECK(!tc.Insert(objs[1], objs[1], 1, size));
+	CHECK(tc.Objects() == 4);
+	CHECK(tc.Remove(start, end) == 4);
+	CHECK(tc.Insert(objs[0], objs[0], 1, size) && tc.Insert(objs[1], objs[1], 1, size));
+	CHECK(!tc.Insert(objs[2], objs[2], 1, size));
+}
+
+//ReleaseFreeMemoryմ仺棬еĶ󻹸span
+void FlushTransferCacheTest()
+{
+	const size_t size = 1024;
+	size_t index = SizeClass::Index(size);
+	size_t batch = SizeClass::NumMoveSize(size);
+	CentralCache* cc = CentralCache::GetInstance();
+	cc->FlushTransferCaches();
+
+	void* start = nullptr;
+	void* end = nullptr;
+	size_t n = cc->FetchRangeObj(start, end, batch, size);
+	CHECK(n >= 1);
+	cc->InsertRange(start, end, n, size);
+
+	size_t spans = 0, pages = 0, objs = 0, freeObjs = 0, transferObjs = 0;
+	cc->GetClassStats(index, spans, pages, objs, freeObjs, transferObjs);
+	CHECK(transferObjs == n);
+
+	PageCache::ReleaseFreeMemory();
+	spans = pages = objs = freeObjs = transferObjs = 0;
+	cc->GetClassStats(index, spans, pages, objs, freeObjs, transferObjs);
+	CHECK(transferObjs == 0);
+}
+
+//thread cacheûжСضʱ仺ֽްʵʴС
+void TransferCacheOddSizeTest()
+{
+	//һСͰʵʴСĿɻͬĴС
+	size_t size = 0;
+	for (size_t s = MAX_BYTES / 8 + 1; s <= MAX_BYTES && size == 0; s++)
+	{
+		size_t classSize = SizeClass::ClassSize(SizeClass::Index(s));
+		if (TransferCache::MAX_CACHED_BYTES / s != TransferCache::MAX_CACHED_BYTES / classSize)
+		{
+			size = s;
+		}
+	}
+	CHECK(size != 0);
+	size_t index = SizeClass::Index(size);
+	size_t classSize = SizeClass::ClassSize(index);
+	CentralCache* cc = CentralCache::GetInstance();
+	cc->FlushTransferCaches();
+
+	//ȫȡȡʱȴӴ仺ãһһػȥȰС޶໹һ
+	std::vector<void*> v(TransferCache::MAX_CACHED_BYTES / size + 1);
+	for (auto& e : v)
+	{
+		void* end = nullptr;
+		CHECK(cc->FetchRangeObj(e, end, 1, classSize) == 1);
+	}
+	for (auto e : v)
+	{
+		cc->InsertRange(e, e, 1, size);
+	}
+
+	size_t spans = 0, pages = 0, objs = 0, freeObjs = 0, transferObjs = 0;
+	cc->GetClassStats(index, spans, pages, objs, freeObjs, transferObjs);
+	CHECK(transferObjs >= 1);
+	CHECK(transferObjs == 1 || transferObjs * classSize <= TransferCache::MAX_CACHED_BYTES);
+	CHECK(transferObjs == TransferCache::MAX_CACHED_BYTES / classSize);
+	cc->FlushTransferCaches();
+}
+
+//central cacheѡʹߵķspanspanᱻѡ
+void SpanBucketTest()
+{
+	SpanBucket bucket;
+	void* obj = nullptr;
+	Span empty, half, full;
+	empty._objCount = half._objCount = full._objCount = 8;
+	empty._freeList = half._freeList = &obj;
+	half._useCount = 4;
+	full._useCount = 8;
+	bucket.Insert(&empty);
+	bucket.Insert(&half);
+	bucket.Insert(&full);
+	CHECK(bucket.PickNonFull() == &half);
+
+	half._freeList = nullptr; //half
+	half._useCount = 8;
+	bucket.Update(&half);
+	CHECK(bucket.PickNonFull() == &empty);
+
+	bucket.Erase(&empty);
+	CHECK(bucket.PickNonFull() == nullptr);
+	bucket.Erase(&half);
+	bucket.Erase(&full);
+}
+
+//spanԤз֣ȡʱŴӻûйĲְַ˳г
+void LazyCarveTest()
+{
+	const size_t size = SizeClass::RoundUp(40 * 1024);
+	CentralCache* central = CentralCache::GetInstance();
+
+	//Ͱpage cachespanֻзַΧΪ
+	SpanBucket bucket;
+	bucket._mtx.lock();
+	Span* span = central->GetOneSpan(bucket, size);
+	char* base = (char*)(span->_pageId << PAGE_SHIFT);
+	CHECK(span->_freeList == nullptr && span->_useCount == 0);
+	CHECK(span->_objCount == (span->_n << PAGE_SHIFT) / size);
+	CHECK(span->_carveNext == base && span->_carveEnd == base + span->_objCount * size);
+	bucket.Erase(span);
+	bucket._mtx.unlock();
+	span->_carveNext = span->_carveEnd = nullptr;
+	span->_next = nullptr;
+	PageCache::ReleaseSpansToPageCache(span);
+
+	//ȡĶзַΧĶ߽ϣspanпеĶȼϻûеĸ
+	void* start = nullptr;
+	void* end = nullptr;
+	size_t n = central->FetchRangeObj(start, end, 3, size); //仺ʱ
+	CHECK(n >= 1);
+	size_t count = 0;
+	for (void* obj = start; obj != nullptr; obj = NextObj(obj))
+	{
+		Span* s = PageCache::GetInstance()->MapObjectToSpan(obj);
+		CHECK(((char*)obj - (char*)(s->_pageId << PAGE_SHIFT)) % size == 0);
+		CHECK((char*)obj + size <= (char*)(s->_pageId << PAGE_SHIFT) + s->_objCount * size);
+		size_t freeObjs = (s->_carveEnd - s->_carveNext) / size;
+		for (void* it = s->_freeList; it != nullptr; it = NextObj(it))
+		{
+			freeObjs++;
+		}
+		CHECK(freeObjs == s->_objCount - s->_useCount);
+		count++;
+	}
+	CHECK(count == n);
+	central->ReleaseListToSpans(start, size);
+}
+
+//̷ֵͬ߳ͬarenaڱ߳ͷʱصʱڵarena
+void PageArenaTest()
+{
+	std::vector<void*> ptrs(NPAGE_ARENAS);
+	std::vector<PageCache*> arenas(NPAGE_ARENAS);
+	std::vector<std::thread> vthread(NPAGE_ARENAS);
+	for (size_t i = 0; i < NPAGE_ARENAS; i++)
+	{
+		vthread[i] = std::thread([&, i]() {
+			ptrs[i] = ConcurrentAlloc(MAX_BYTES + 1);
+			arenas[i] = PageCache::GetInstance();
+			CHECK(PageCache::GetArena(PageCache::GetInstance()->MapObjectToSpan(ptrs[i])) == arenas[i]);
+		});
+	}
+	for (auto& t : vthread)
+	{
+		t.join();
+	}
+	//ת䣬NPAGE_ARENAS߳õarenaͬ
+	std::sort(arenas.begin(), arenas.end());
+	CHECK(std::unique(arenas.begin(), arenas.end()) == arenas.end());
+	for (size_t i = 0; i < NPAGE_ARENAS; i++)
+	{
+		ConcurrentFree(ptrs[i]);
+	}
+}
+
+//ַ£NewSpanйĿspanѡַ͵ģ
+//һҳй֪СĿspanӽͲѡֲԸеĸspan
+void PagePolicyTest()
+{
+	PageCache::SetPolicy(PAGE_ADDRESS_ORDERED);
+	PageCache* arena = PageCache::GetInstance();
+	arena->_pageMtx.lock();
+	//֮ǰĲԿ˵ַߵĿspanг4spanһַȰַ
+	Span* spans[4];
+	for (size_t i = 0; i < 4; i++)
+	{
+		spans[i] = arena->NewSpan(10);
+	}
+	std::sort(spans, spans + 4, [](Span* a, Span* b) { return a->_pageId < b->_pageId; });
+	PAGE_ID highId = spans[2]->_pageId;
+	arena->ReleaseSpanToPageCache(spans[0]);
+	arena->ReleaseSpanToPageCache(spans[2]); //spans[0]֮ʹеspans[1]ϲ
+	Span* span = arena->NewSpan(5);
+	CHECK(span->_pageId < highId);
+	arena->ReleaseSpanToPageCache(span);
+	arena->ReleaseSpanToPageCache(spans[1]);
+	arena->ReleaseSpanToPageCache(spans[3]);
+	arena->_pageMtx.unlock();
+	PageCache::SetPolicy(PAGE_BEST_FIT);
+
+	//һarenaжûпspanͰk湹k+1ҳAk+2ҳB128ҳC
+	size_t counts[NPAGES] = { 0 };
+	size_t largeSpans = 0, largePages = 0, mappedBytes = 0, freeBytes = 0, releasedBytes = 0;
+	PageCache::GetPageStats(counts, largeSpans, largePages, mappedBytes, freeBytes, releasedBytes);
+	size_t k = 2;
+	while (k < NPAGES - 3 && counts[k] != 0)
+	{
+		k++;
+	}
+	CHECK(k < NPAGES - 3);
+
+	//ʣβܱϵͳ
+	PageCache::SetLargeSpanLimit((size_t)1 << 40);
+	PageCache::SetReleaseTriggerBytes(0);
+	arena->_pageMtx.lock();
+	//пеĴspan󣬵һһϵͳҳ֮ÿζֻʣβ
+	//гABCһֱʹãABCͷź󲻻ͱspanϲ
+	size_t rest = largePages + NPAGES + 1024;
+	const size_t pieceSizes[] = { 1, k + 1, 1, k + 2, 1, NPAGES - 1, 1 };
+	std::vector<Span*> pieces;
+	PAGE_ID next = 0;
+	for (size_t n : pieceSizes)
+	{
+		Span* piece = arena->NewSpan(rest);
+		CHECK(next == 0 || piece->_pageId == next);
+		CHECK(arena->ResizeSpan(piece, n));
+		next = piece->_pageId + n;
+		rest -= n;
+		pieces.push_back(piece);
+	}
+	PAGE_ID idA = pieces[1]->_pageId, idB = pieces[3]->_pageId, idC = pieces[5]->_pageId;
+	arena->ReleaseSpanToPageCache(pieces[1]);
+	arena->ReleaseSpanToPageCache(pieces[3]);
+	arena->ReleaseSpanToPageCache(pieces[5]); //Cͷţ128ҳͰͷ
+
+	std::vector<Span*> used;
+	PageCache::SetPolicy(PAGE_FIRST_FIT);
+	//PAGE_FIRST_FITk+2ҳͰǿվB
+	used.push_back(arena->NewSpan(k + 2));
+	CHECK(used.back()->_pageId == idB && used.back()->_n == k + 2);
+	//kҳͰΪʱѡֱͰеCҳӽA
+	used.push_back(arena->NewSpan(k));
+	CHECK(used.back()->_pageId == idC);
+	PageCache::SetPolicy(PAGE_BEST_FIT);
+	//PAGE_BEST_FITkҳͰΪգҳӽACʣĲ
+	used.push_back(arena->NewSpan(k));
+	CHECK(used.back()->_pageId == idA);
+
+	for (Span* e : used)
+	{
+		arena->ReleaseSpanToPageCache(e);
+	}
+	for (size_t i = 0; i < pieces.size(); i += 2)
+	{
+		arena->ReleaseSpanToPageCache(pieces[i]);
+	}
+	arena->_pageMtx.unlock();
+	PageCache::SetReleaseTriggerBytes(PageCache::DEFAULT_RELEASE_TRIGGER_BYTES);
+	PageCache::SetLargeSpanLimit(PageCache::DEFAULT_LARGE_SPAN_LIMIT);
+}
+
+//128ҳĴڴͷź󻺴arenaУٴʱáз֣޲Żϵͳ
+void LargeSpanCacheTest()
+{
+	//ǰĲͷŵspanϲҲڴspanУգ֤p1з
+	PageCache::SetLargeSpanLimit(0);
+	ConcurrentFree(ConcurrentAlloc(4 * 1024 * 1024));
+	PageCache::SetLargeSpanLimit(PageCache::DEFAULT_LARGE_SPAN_LIMIT);
+
+	void* p1 = ConcurrentAlloc(4 * 1024 * 1024);
+	ConcurrentFree(p1);
+	void* p2 = ConcurrentAlloc(2 * 1024 * 1024); //ӻ4MBͷ
+	CHECK(p2 == p1);
+	void* p3 = ConcurrentAlloc(2 * 1024 * 1024); //ʣµ2MBù
+	CHECK((char*)p3 == (char*)p1 + 2 * 1024 * 1024);
+	ConcurrentFree(p2);
+	ConcurrentFree(p3);
+
+	PageCache* arena = PageCache::GetInstance();
+	arena->_pageMtx.lock();
+	CHECK(arena->LargeSpanBytes() >= 4 * 1024 * 1024);
+	arena->_pageMtx.unlock();
+
+	PageCache::SetLargeSpanLimit(0);
+	void* p4 = ConcurrentAlloc(8 * 1024 * 1024);
+	ConcurrentFree(p4);
+	arena->_pageMtx.lock();
+	CHECK(arena->LargeSpanBytes() == 0);
+	arena->_pageMtx.unlock();
+	PageCache::SetLargeSpanLimit(PageCache::DEFAULT_LARGE_SPAN_LIMIT);
+}
+
+//еҳʽɺ̨̹߳黹ϵͳ黹
+void ReleaseFreeMemoryTest()
+{
+	const size_t bytes = 1024 * 1024;
+	char* p1 = (char*)ConcurrentAlloc(bytes);
+	memset(p1, 1, bytes);
+	ConcurrentFree(p1);
+	CHECK(PageCache::ReleaseFreeMemory() >= bytes);
+	CHECK(PageCache::ReleasedBytes() >= bytes);
+	CHECK(PageCache::ReleaseFreeMemory() == 0); //Ѿ黹Ĳظ黹
+
+	char* p2 = (char*)ConcurrentAlloc(bytes);
+	memset(p2, 2, bytes); //黹ҳȱҳʹ
+	ConcurrentFree(p2);
+
+	//̨̹߳黹õspan
+	PageCache::SetReleaseAge(0);
+	CHECK(PageCache::StartBackgroundRelease(1));
+	CHECK(!PageCache::StartBackgroundRelease(1));
+	char* p3 = (char*)ConcurrentAlloc(bytes);
+	memset(p3, 3, bytes);
+	size_t released = PageCache::ReleasedBytes();
+	ConcurrentFree(p3);
+	for (int i = 0; i < 1000 && PageCache::ReleasedBytes() < released + bytes; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(PageCache::ReleasedBytes() >= released + bytes);
+	PageCache::StopBackgroundRelease();
+	PageCache::SetReleaseAge(PageCache::DEFAULT_RELEASE_AGE_MS);
+}
+
+//ҳģʽڴ水2MB룬Զ黹ֻ黹Ĵҳ
+void HugePageTest()
+{
+	void* region = SystemAllocAligned(HUGE_PAGE_PAGES, HUGE_PAGE_PAGES);
+	CHECK(((uintptr_t)region & ((HUGE_PAGE_PAGES << PAGE_SHIFT) - 1)) == 0);
+	SystemFree(region, HUGE_PAGE_PAGES);
+
+	PageCache::SetHugePageMode(true);
+	PageCache::SetLargeSpanLimit((size_t)1 << 30);
+	PageCache::SetReleaseAge(0);
+	PageCache::SetReleaseTriggerBytes(1); //ÿͷŶõspan
+
+	//ȴspan޻һϵͳ
+	const size_t bytes = ((size_t)100 << 20) + (1 << PAGE_SHIFT);
+	size_t released = PageCache::ReleasedBytes();
+	char* p = (char*)ConcurrentAlloc(bytes);
+	CHECK(((uintptr_t)p & ((HUGE_PAGE_PAGES << PAGE_SHIFT) - 1)) == 0);
+	memset(p, 1, bytes);
+	ConcurrentFree(p);
+	CHECK(PageCache::ReleasedBytes() >= released + ((size_t)100 << 20)); //50ҳѾ黹
+	CHECK(PageCache::ReleaseFreeMemory() >= ((size_t)1 << PAGE_SHIFT)); //һҳβֻʽ黹ʱŹ黹
+
+	PageCache::SetReleaseTriggerBytes(PageCache::DEFAULT_RELEASE_TRIGGER_BYTES);
+	PageCache::SetReleaseAge(PageCache::DEFAULT_RELEASE_AGE_MS);
+	PageCache::SetLargeSpanLimit(PageCache::DEFAULT_LARGE_SPAN_LIMIT);
+	PageCache::SetHugePageMode(false);
+}
+
+void AlignedAllocTest()
+{
+	for (size_t align = 8; align <= ((size_t)64 << 10); align <<= 1)
+	{
+		for (size_t size : { (size_t)1, (size_t)24, (size_t)1000, (size_t)9000, (size_t)70000, MAX_BYTES + 1 })
+		{
+			void* ptr = ConcurrentAllocAligned(size, align);
+			CHECK(((uintptr_t)ptr & (align - 1)) == 0);
+			CHECK(ConcurrentUsableSize(ptr) >= size);
+			memset(ptr, 1, size);
+			ConcurrentFree(ptr);
+		}
+	}
+
+	//ûڴ߳ͷű߳Ķ
+	void* ptr = ConcurrentAlloc(100);
+	std::thread t([ptr]() {
+		ConcurrentFree(ptr);
+	});
+	t.join();
+}
+
+void ReallocTest()
+{
+	//´СͬһͰʱԭط
+	char* p = (char*)ConcurrentAlloc(20);
+	CHECK(ConcurrentRealloc(p, 24) == p);
+	memset(p, 7, 24);
+	p = (char*)ConcurrentRealloc(p, 5000);
+	CHECK(p[23] == 7);
+
+	//ڴԭСȥβҳں棬ʱԭ̲
+	char* big = (char*)ConcurrentAlloc((size_t)1 << 20);
+	memset(big, 3, (size_t)1 << 20);
+	CHECK(ConcurrentRealloc(big, 300 * 1024) == big);
+	CHECK(ConcurrentUsableSize(big) == SizeClass::RoundUp(300 * 1024));
+	CHECK(ConcurrentRealloc(big, (size_t)1 << 20) == big);
+	CHECK(ConcurrentUsableSize(big) == ((size_t)1 << 20));
+	CHECK(big[300 * 1024 - 1] == 3);
+
+	//256KBʱᵽС
+	char* small = (char*)ConcurrentRealloc(big, 1000);
+	CHECK(small[999] == 3);
+	ConcurrentFree(small);
+	ConcurrentFree(p);
+	p = (char*)ConcurrentRealloc(nullptr, 10);
+	CHECK(ConcurrentRealloc(p, 0) == nullptr);
+}
+
+void AllocStatsTest()
+{
+	AllocStats before;
+	GetAllocStats(before);
+	std::vector<void*> ptrs;
+	for (size_t i = 0; i < 1000; i++)
+	{
+		ptrs.push_back(ConcurrentAlloc(100));
+	}
+	void* big = ConcurrentAlloc((size_t)1 << 20);
+
+	AllocStats stats;
+	GetAllocStats(stats);
+	size_t index = SizeClass::Index(100);
+	CHECK(stats._classes[index].InUseObjs() >= before._classes[index].InUseObjs() + 1000);
+	CHECK(stats._largeInUseBytes >= before._largeInUseBytes + ((size_t)1 << 20));
+	CHECK(stats._mappedBytes >= stats._inUseBytes);
+	CHECK(stats._threadCaches >= 1);
+	std::string json = AllocStatsToJson(stats);
+	CHECK(json.front() == '{' && json.back() == '}');
+	CHECK(json.find("\"size_classes\"") != std::string::npos);
+	CHECK(!AllocStatsToText(stats).empty());
+
+	for (void* ptr : ptrs)
+	{
+		ConcurrentFree(ptr);
+	}
+	ConcurrentFree(big);
+	GetAllocStats(stats);
+	CHECK(stats._classes[index].InUseObjs() <= before._classes[index].InUseObjs());
+}
+
+//֤ڲĵջ
+__attribute__((noinline)) static void* HeapProfilerAlloc(size_t size)
+{
+	return ConcurrentAlloc(size);
+}
+
+void HeapProfilerTest()
+{
+	size_t before = HeapProfiler::LiveSamples();
+	HeapProfiler::SetSampleInterval(64 * 1024);
+	std::vector<void*> ptrs;
+	for (size_t i = 0; i < 10000; i++) //Լ10MBԼ160
+	{
+		ptrs.push_back(HeapProfilerAlloc(1000));
+	}
+	void* big = HeapProfilerAlloc((size_t)1 << 20); //ڲһ
+	size_t live = HeapProfiler::LiveSamples();
+	CHECK(live > before + 50);
+
+	std::string pprof = HeapProfiler::DumpPprof();
+	CHECK(pprof.compare(0, 13, "heap profile:") == 0);
+	CHECK(pprof.find("heap_v2/65536") != std::string::npos);
+	CHECK(!HeapProfiler::DumpCollapsed().empty());
+
+	//ĴڴreallocʱԭСﻹǾɵĴС
+	CHECK(pprof.find(" 1048576 [") != std::string::npos);
+	big = ConcurrentRealloc(big, (size_t)512 << 10);
+	pprof = HeapProfiler::DumpPprof();
+	CHECK(pprof.find(" 1048576 [") == std::string::npos);
+	CHECK(pprof.find(" 524288 [") != std::string::npos);
+
+	//Ķҳ䣬СͷҲȷ
+	for (void* ptr : ptrs)
+	{
+		ConcurrentFree(ptr, 1000);
+	}
+	ConcurrentFree(big);
+	CHECK(HeapProfiler::LiveSamples() == before);
+	HeapProfiler::SetSampleInterval(0);
+}
+
+//̰߳ȫĶأ졢ͷš߳̽ͷţеĿ黹ȥ
+struct PoolNode
+{
+	static inline std::atomic<int> _live{ 0 };
+	alignas(32) size_t _id;
+	size_t _value;
+	PoolNode(size_t id = 0, size_t value = 0)
+		:_id(id)
+		, _value(value)
+	{
+		_live++;
+	}
+	~PoolNode()
+	{
+		_live--;
+	}
+};
+
+void ConcurrentObjectPoolTest()
+{
+	ConcurrentObjectPool<PoolNode> pool;
+	PoolNode* node = pool.New(7, 8);
+	CHECK(node->_id == 7 && node->_value == 8);
+	CHECK((uintptr_t)node % alignof(PoolNode) == 0);
+	pool.Delete(node);
+	CHECK(PoolNode::_live == 0);
+
+	//Ķ󻥲صͬĲ
+	const size_t n = 3 * ConcurrentObjectPool<PoolNode>::CHUNK_BYTES / sizeof(PoolNode);
+	std::vector<PoolNode*> nodes(n);
+	pool.NewN(nodes.data(), n, 1, 2);
+	std::vector<PoolNode*> sorted = nodes;
+	std::sort(sorted.begin(), sorted.end());
+	for (size_t i = 0; i < n; i++)
+	{
+		CHECK(nodes[i]->_id == 1 && nodes[i]->_value == 2);
+		CHECK(i == 0 || (char*)sorted[i] >= (char*)sorted[i - 1] + sizeof(PoolNode));
+	}
+	CHECK(PoolNode::_live == (int)n);
+	CHECK(pool.Chunks() >= 3);
+	pool.DeleteN(nodes.data(), n);
+	CHECK(PoolNode::_live == 0);
+	//Ķ󻹸󣬿ȫУڴ
+	pool.Trim();
+	CHECK(pool.Chunks() == 0);
+
+	//캯׳쳣ʱڴ滹ض
+	struct Throwing
+	{
+		Throwing(bool fail)
+		{
+			if (fail)
+				throw std::runtime_error("ctor");
+		}
+	};
+	ConcurrentObjectPool<Throwing> throwingPool;
+	bool caught = false;
+	try
+	{
+		throwingPool.New(true);
+	}
+	catch (const std::runtime_error&)
+	{
+		caught = true;
+	}
+	CHECK(caught);
+	throwingPool.Delete(throwingPool.New(false));
+	throwingPool.Trim();
+	CHECK(throwingPool.Chunks() == 0);
+
+	//߳룬ɱ߳ͷ
+	const size_t nthreads = 4;
+	const size_t perThread = 20000;
+	std::vector<std::vector<PoolNode*>> owned(nthreads);
+	std::vector<std::thread> threads;
+	for (size_t k = 0; k < nthreads; k++)
+	{
+		threads.emplace_back([&, k]() {
+			for (size_t i = 0; i < perThread; i++)
+			{
+				owned[k].push_back(pool.New(k, i));
+				if (i % 3 == 0) //һͷţmagazine֮
+				{
+					pool.Delete(owned[k].back());
+					owned[k].pop_back();
+				}
+			}
+		});
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	threads.clear();
+	for (size_t k = 0; k < nthreads; k++)
+	{
+		threads.emplace_back([&, k]() {
+			std::vector<PoolNode*>& objs = owned[(k + 1) % nthreads];
+			for (size_t i = 0; i < objs.size(); i++)
+			{
+				CHECK(objs[i]->_id == (k + 1) % nthreads);
+			}
+			pool.DeleteN(objs.data(), objs.size());
+		});
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	CHECK(PoolNode::_live == 0);
+	pool.Trim();
+	CHECK(pool.Chunks() == 0);
+}
+
+//ӽtesttestCHECKʧܻʱй©ʱӽ쳣̼˳״̬
+//Ƶַռ֮Ӱ̵Ĳ
+static void RunInChild(void (*test)())
+{
+#ifndef _WIN32
+	pid_t pid = fork();
+	CHECK(pid >= 0);
+	if (pid == 0)
+	{
+		alarm(30);
+		test();
+		_exit(0); //ִиעatexit
+	}
+	int status = 0;
+	CHECK(waitpid(pid, &status, 0) == pid);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#else
+	(void)test;
+#endif
+}
+
+//ѵַռΪǰСټextraBytes֮󳬳붼ʧ
+static void LimitAddressSpace(size_t extraBytes)
+{
+#ifndef _WIN32
+	size_t vmPages = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	CHECK(statm != nullptr && fscanf(statm, "%zu", &vmPages) == 1);
+	fclose(statm);
+	struct rlimit limit;
+	CHECK(getrlimit(RLIMIT_AS, &limit) == 0);
+	limit.rlim_cur = (rlim_t)(vmPages * (size_t)sysconf(_SC_PAGESIZE) + extraBytes);
+	CHECK(setrlimit(RLIMIT_AS, &limit) == 0);
+#else
+	(void)extraBytes;
+#endif
+}
+
+//ȡLimitAddressSpaceƣƻָӲƣ
+static void UnlimitAddressSpace()
+{
+#ifndef _WIN32
+	struct rlimit limit;
+	CHECK(getrlimit(RLIMIT_AS, &limit) == 0);
+	limit.rlim_cur = limit.rlim_max;
+	CHECK(setrlimit(RLIMIT_AS, &limit) == 0);
+#endif
+}
+
+//زʱڴʧܣ쳣ߣλͷţ֮ͬһ̻ܼ߳ʹö
+struct BigPoolNode
+{
+	char _data[(size_t)4 << 20];
+};
+
+void ConcurrentObjectPoolRefillFailTest()
+{
+	RunInChild([]() {
+		ConcurrentObjectPool<BigPoolNode> pool;
+		LimitAddressSpace((size_t)16 << 20); //Ųһ飨644MBĶ󣬱page cacheпܻĿspan
+		for (size_t i = 0; i < 2; i++) //λй©ʱڶλһֱalarm
+		{
+			bool caught = false;
+			try
+			{
+				pool.New();
+			}
+			catch (const std::bad_alloc&)
+			{
+				caught = true;
+			}
+			CHECK(caught);
+		}
+		BigPoolNode* objs[4];
+		bool caught = false;
+		try
+		{
+			pool.NewN(objs, 4);
+		}
+		catch (const std::bad_alloc&)
+		{
+			caught = true;
+		}
+		CHECK(caught);
+
+		UnlimitAddressSpace();
+		BigPoolNode* node = pool.New();
+		node->_data[0] = 1;
+		pool.NewN(objs, 4);
+		pool.DeleteN(objs, 4);
+		pool.Delete(node);
+		pool.Trim();
+		CHECK(pool.Chunks() == 0);
+	});
+}
+
+//mallocϵк壬PreloadUnitTestlibcmpmalloc.soṩ
+void MallocTest()
+{
+	void* ptr = nullptr;
+	CHECK(posix_memalign(&ptr, (size_t)64 << 10, 100) == 0);
+	CHECK(((uintptr_t)ptr & (((size_t)64 << 10) - 1)) == 0);
+	free(ptr);
+	ptr = aligned_alloc(4096, 4096 * 3);
+	CHECK(((uintptr_t)ptr & 4095) == 0);
+	free(ptr);
+
+	char* p = (char*)calloc(1000, 3);
+	for (size_t i = 0; i < 3000; i++)
+	{
+		CHECK(p[i] == 0);
+		p[i] = (char)i;
+	}
+	p = (char*)realloc(p, 500000);
+	for (size_t i = 0; i < 3000; i++)
+	{
+		CHECK(p[i] == (char)i);
+	}
+	p = (char*)realloc(p, 100);
+	for (size_t i = 0; i < 100; i++)
+	{
+		CHECK(p[i] == (char)i);
+	}
+	free(p);
+
+	struct alignas(256) Aligned
+	{
+		char _data[300];
+	};
+	Aligned* a = new Aligned[3];
+	CHECK(((uintptr_t)a & 255) == 0);
+	delete[] a;
+}
+
+//ַռʱmallocϵзؿָ벢ENOMEMPreloadUnitTestlibcmpmalloc.soṩ
+//ConcurrentAlloc׳bad_allocʧʱarenaѾͷţ֮ڴ治
+void OutOfMemoryTest()
+{
+	RunInChild([]() {
+		LimitAddressSpace((size_t)256 << 20);
+
+		const size_t huge = (size_t)2 << 30;
+		errno = 0;
+		CHECK(malloc(huge) == nullptr && errno == ENOMEM);
+		errno = 0;
+		CHECK(calloc(1, huge) == nullptr && errno == ENOMEM);
+		void* ptr = nullptr;
+		CHECK(posix_memalign(&ptr, (size_t)1 << 20, huge) == ENOMEM && ptr == nullptr);
+		errno = 0;
+		CHECK(aligned_alloc((size_t)1 << 20, huge) == nullptr && errno == ENOMEM);
+		char* p = (char*)malloc(100);
+		CHECK(p != nullptr);
+		p[99] = 'x';
+		errno = 0;
+		void* q = realloc(p, huge);
+		CHECK(q == nullptr && errno == ENOMEM);
+		if (q == nullptr) //reallocʧʱԭڴ治
+		{
+			CHECK(p[99] == 'x');
+		}
+		free(p);
+
+		bool caught = false;
+		try
+		{
+			ConcurrentAlloc(huge);
+		}
+		catch (const std::bad_alloc&)
+		{
+			caught = true;
+		}
+		CHECK(caught);
+		caught = false;
+		try
+		{
+			ConcurrentAllocAligned(huge, (size_t)1 << 20);
+		}
+		catch (const std::bad_alloc&)
+		{
+			caught = true;
+		}
+		CHECK(caught);
+
+		//ܷأɹʧܣ˵arenaûй©
+		try
+		{
+			ConcurrentFree(ConcurrentAlloc((size_t)1 << 20));
+		}
+		catch (const std::bad_alloc&)
+		{
+		}
+		free(malloc((size_t)1 << 20));
+	});
+}
+
+//CMakeUnitTestִгʹøڣVSBenchmark.cppmain
+#ifdef CMP_UNIT_TEST_MAIN
+int main()
+{
+	TLSTest();
+	TestConcurrentAlloc1();
+	TestConcurrentAlloc2();
+	MultiThreadAllocTest();
+	BigAlloc();
+	MultiThreadFreeTest();
+	SizedFreeTest();
+	CpuCacheTest();
+	ThreadExitTest();
+	ThreadCacheBudgetTest();
+	AdaptiveListTest();
+	RemoteFreeTest();
+	TransferCacheTest();
+	FlushTransferCacheTest();
+	TransferCacheOddSizeTest();
+	SpanBucketTest();
+	LazyCarveTest();
+	PageArenaTest();
+	PagePolicyTest();
+	LargeSpanCacheTest();
+	ReleaseFreeMemoryTest();
+	HugePageTest();
+	AlignedAllocTest();
+	ReallocTest();
+	AllocStatsTest();
+	HeapProfilerTest();
+	ConcurrentObjectPoolTest();
+	ConcurrentObjectPoolRefillFailTest();
+	MallocTest();
+	OutOfMemoryTest();
+	cout << "UnitTest passed" << endl;
+	return 0;
+}
+#endif
\ No newline at end of file